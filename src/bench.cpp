@@ -0,0 +1,197 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include "tree.h"
+#include "node_index.h"
+#include "codec.h"
+#include "wrap_zmq.h"
+
+using namespace std;
+
+// Микробенчмарки структур сервера. Запуск: make bench && ./bench [кол-во узлов]
+
+#define MAX_VALUES 1000 // Наибольший вектор exec, как MAX_SIZE сообщения
+#define HOPS 4 // Пересылок PUB/SUB в бенчмарке пересылки, как на пути к узлу глубины 4
+
+static volatile long long sink; // Не даёт компилятору выбросить измеряемый код
+
+// Подмена malloc: считает выделения памяти всего процесса, в том числе внутри libzmq
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static atomic<long long> allocs(0);
+
+extern "C" void* malloc(size_t size) {
+	allocs.fetch_add(1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+	allocs.fetch_add(1, memory_order_relaxed);
+	return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+	allocs.fetch_add(1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+template <class F>
+double measure(int ops, F f) { // Возвращает нс на операцию
+	auto start = chrono::steady_clock::now();
+	f();
+	auto finish = chrono::steady_clock::now();
+	return chrono::duration<double, nano>(finish - start).count() / ops;
+}
+
+template <class T>
+void bench_topology(const char* name, const vector<int>& keys, const vector<int>& queries) {
+	T t;
+	double insert_ns = measure(keys.size(), [&]() {
+		for (int key : keys) {
+			t.insert(key);
+		}
+	});
+	double find_ns = measure(queries.size(), [&]() {
+		long long found = 0;
+		for (int q : queries) {
+			found += t.find(q);
+		}
+		sink = found;
+	});
+	double place_ns = measure(queries.size(), [&]() {
+		long long sum = 0;
+		for (int q : queries) {
+			sum += t.get_place(q);
+		}
+		sink = sum;
+	});
+	int rounds = 1000;
+	double all_ns = measure(rounds, [&]() { // Один обход, как в раунде heartbit
+		long long sum = 0;
+		for (int r = 0; r < rounds; r++) {
+			for (int id : t.get_all_elems()) {
+				sum += id;
+			}
+		}
+		sink = sum;
+	});
+	cout << left << setw(12) << name << right << fixed << setprecision(1)
+		<< setw(12) << insert_ns << setw(12) << find_ns
+		<< setw(12) << place_ns << setw(16) << all_ns << "\n";
+}
+
+void bench_codecs(const char* data_name, const vector<int>& values) { // Размер и скорость кодеков на одном векторе exec
+	int n = values.size();
+	int rounds = 20000;
+	vector<unsigned char> packed(n * sizeof(int) * 2 + 64);
+	for (Codec codec : {Codec::RAW, Codec::DELTA_VARINT, Codec::FOR_BITPACK}) {
+		int bytes = 0;
+		double encode_ns = measure(rounds * n, [&]() {
+			for (int r = 0; r < rounds; r++) {
+				bytes = encode_values(codec, values.data(), n, packed.data(), packed.size());
+			}
+		});
+		double sum_ns = measure(rounds * n, [&]() {
+			long long sum = 0;
+			for (int r = 0; r < rounds; r++) {
+				sum += decode_sum(codec, packed.data(), n, bytes);
+			}
+			sink = sum;
+		});
+		cout << left << setw(10) << data_name << setw(8) << codec_name(codec) << right << fixed << setprecision(2)
+			<< setw(10) << bytes << setw(14) << encode_ns << setw(14) << sum_ns << "\n";
+	}
+}
+
+void bench_forwarding(void* context, int values, int messages) { // Сообщение проходит HOPS пар PUB/SUB в одном потоке, как по цепочке узлов
+	vector<void*> publishers(HOPS), subscribers(HOPS);
+	for (int i = 0; i < HOPS; i++) {
+		publishers[i] = create_zmq_socket(context, SocketType::PUBLISHER);
+		subscribers[i] = create_zmq_socket(context, SocketType::SUBSCRIBER);
+		string endpoint = create_endpoint(EndpointType::CHILD_PUB_LEFT, i);
+		bind_zmq_socket(publishers[i], endpoint);
+		connect_zmq_socket(subscribers[i], endpoint);
+		subscribe_zmq_socket(subscribers[i], i + 1); // Как ребёнок: только сообщения со своим route
+	}
+	Message msg, extra;
+	msg.command = CommandType::EXEC_CHILD;
+	msg.size = values;
+	for (int i = 0; i < values; i++) {
+		msg.buf[i] = i;
+	}
+	for (int i = 0; i < HOPS; i++) { // Ждём, пока подписка дойдёт до издателя: до этого PUB молча теряет сообщения
+		msg.route = i + 1;
+		do {
+			send_zmq_msg(publishers[i], msg);
+		} while (!get_zmq_msg(subscribers[i], msg, ZMQ_DONTWAIT));
+		while (get_zmq_msg(subscribers[i], extra, ZMQ_DONTWAIT)) {}
+	}
+	long long allocs_before = allocs.load();
+	double hop_ns = measure(messages * HOPS, [&]() {
+		for (int m = 0; m < messages; m++) {
+			for (int i = 0; i < HOPS; i++) {
+				msg.route = i + 1;
+				send_zmq_msg(publishers[i], msg);
+				if (!get_zmq_msg(subscribers[i], msg)) {
+					throw runtime_error("Message lost.");
+				}
+			}
+		}
+	});
+	double hop_allocs = (double)(allocs.load() - allocs_before) / (messages * HOPS);
+	cout << setw(10) << values << setw(12) << msg.wire_size() << fixed << setprecision(1)
+		<< setw(14) << hop_ns << setprecision(2) << setw(14) << hop_allocs << "\n";
+	for (int i = 0; i < HOPS; i++) { // Без обёрток, которые ждут секунду. Адрес inproc освобождаем сразу: его займёт следующий прогон
+		zmq_unbind(publishers[i], create_endpoint(EndpointType::CHILD_PUB_LEFT, i).data());
+		zmq_close(subscribers[i]);
+		zmq_close(publishers[i]);
+	}
+}
+
+int main(int argc, char const *argv[]) {
+	int n = argc > 1 ? stoi(argv[1]) : 5000;
+	mt19937 gen(42);
+	vector<int> keys(n);
+	for (int i = 0; i < n; i++) {
+		keys[i] = i * 2;
+	}
+	shuffle(keys.begin(), keys.end(), gen);
+	vector<int> queries(1000000);
+	uniform_int_distribution<int> dist(0, 2 * n);
+	for (int& q : queries) {
+		q = dist(gen);
+	}
+	cout << "nodes: " << n << "\n";
+	cout << left << setw(12) << "structure" << right << setw(12) << "insert ns"
+		<< setw(12) << "find ns" << setw(12) << "place ns" << setw(16) << "all elems ns" << "\n";
+	bench_topology<tree>("tree", keys, queries);
+	bench_topology<node_index>("node_index", keys, queries);
+	vector<int> small(MAX_VALUES), sorted(MAX_VALUES), random(MAX_VALUES);
+	uniform_int_distribution<int> small_dist(-100, 100), any_dist;
+	for (int i = 0; i < MAX_VALUES; i++) {
+		small[i] = small_dist(gen);
+		sorted[i] = any_dist(gen) / MAX_VALUES;
+		random[i] = any_dist(gen);
+	}
+	sort(sorted.begin(), sorted.end());
+	cout << "\nexec values: " << MAX_VALUES << "\n";
+	cout << left << setw(10) << "data" << setw(8) << "codec" << right << setw(10) << "bytes"
+		<< setw(14) << "encode ns" << setw(14) << "sum ns" << "\n";
+	bench_codecs("small", small);
+	bench_codecs("sorted", sorted);
+	bench_codecs("random", random);
+	set_transport(Transport::INPROC);
+	void* context = create_zmq_ctx();
+	cout << "\nforwarding: " << HOPS << " inproc PUB/SUB hops\n";
+	cout << setw(10) << "ints" << setw(12) << "bytes" << setw(14) << "ns/hop" << setw(14) << "allocs/hop" << "\n";
+	bench_forwarding(context, 3, 200000);
+	bench_forwarding(context, MAX_VALUES, 200000);
+	zmq_ctx_destroy(context);
+	return 0;
+}
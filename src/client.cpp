@@ -3,57 +3,51 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <functional>
 #include <csignal>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include "wrap_zmq.h"
 #include "socket.h"
+#include "node_core.h"
+#include "placement.h"
+#include "clock.h"
 
 using namespace std;
 
+void* worker_func(void* client);
 
-class Client {
+class Client : public node_core { // Процесс узла: дети запускаются через fork, задачи исполняет отдельный поток
 private:
-	int id; // ID
-	void* context; // Контекст
 	bool terminated; // Переменная работоспособности
+	pthread_t worker_thread; // Поток-исполнитель задач
 public:
-	Socket* child_publisher_left;
-	Socket* child_publisher_right; 
-	Socket* parent_publisher; 
-	Socket* parent_subscriber;
-	Socket* left_subscriber;
-	Socket* right_subscriber; 
-	Client(int new_id, string parent_endpoint, int new_parent_id) { // Конструктор клиента
-		id = new_id; 
+	Client(int new_id, string parent_endpoint, int new_parent_id) : node_core(create_zmq_ctx(), new_id, getpid(), parent_endpoint) { // Конструктор клиента
 		parent_id = new_parent_id;
-		context = create_zmq_ctx(); // Создание контекста
-		string endpoint = create_endpoint(EndpointType::CHILD_PUB_LEFT, getpid()); // Создаёт  endpoint
-		child_publisher_left = new Socket(context, SocketType::PUBLISHER, endpoint);
-		endpoint = create_endpoint(EndpointType::CHILD_PUB_RIGHT, getpid()); // Создаёт  endpoint
-		child_publisher_right = new Socket(context, SocketType::PUBLISHER, endpoint); 
-		endpoint = create_endpoint(EndpointType::PARENT_PUB, getpid()); // Создаёт endpoint
-		parent_publisher = new Socket(context, SocketType::PUBLISHER, endpoint); 
-		parent_subscriber = new Socket(context, SocketType::SUBSCRIBER, parent_endpoint); 
-		left_subscriber = nullptr;
-		right_subscriber = nullptr; 
 		terminated = false;
+		if (pthread_create(&worker_thread, 0, worker_func, this) != 0) {
+			throw runtime_error("Can not run worker thread.");
+		}
 	}
 	~Client() { // Деструктор клиента
+		stop();
+	}
+	void stop() { // Останавливает исполнителя и закрывает сокеты; объект остаётся живым до выхода из области видимости
 		if (terminated) {
 			return;
 		}
 		terminated = true;
+		jobs.close();
+		pthread_join(worker_thread, NULL);
 		try {
-			delete child_publisher_left;
-			delete child_publisher_right;
 			delete parent_publisher;
 			delete parent_subscriber;
-			if (left_subscriber) {
-				delete left_subscriber;
+			if (children_publisher) {
+				delete children_publisher;
 			}
-			if (right_subscriber) {
-				delete right_subscriber;
+			if (children_subscriber) {
+				delete children_subscriber;
 			}
 			destroy_zmq_ctx(context); // Уничтожение контекста
 		} 
@@ -64,105 +58,46 @@ public:
 	bool& get_status() { // Получение статуса
 		return terminated;
 	}
-	void send_up(Message msg) { // Отправляет сообщение сокету родителя
-		msg.to_up = true;
-		parent_publisher->send(msg);
-	}
-	void send_down(Message msg) { // Отправляет сообщение сокету ребёнка
-		msg.to_up = false;
-		child_publisher_left->send(msg);
-		child_publisher_right->send(msg);
-	}
-	Message receive(); // Получение сообщения
-	int get_id() { // Получение id
-		return id;
-	}
-	int add_child(int new_id) { // Добавить ребёнка
-		pid_t pid = fork();
-		if (pid == -1) {
+	int parent_id; //id родителя
+protected:
+	pid_t spawn(int new_id, const string& endpoint, int cpu) override { // Ребёнок — новый процесс client, привязанный к ядру cpu
+		int numa = cpu_numa_node(cpu); // sysfs читается до fork: после него в ребёнке только системные вызовы
+		pid_t child_pid = fork();
+		if (child_pid == -1) {
 			throw runtime_error("Can not fork.");
 		}
-		if (pid == 0) {
-			string endpoint;
-			if (new_id < id) {
-				endpoint = child_publisher_left->get_endpoint();
-			} 
-			else {
-				endpoint = child_publisher_right->get_endpoint();
-			}
+		if (child_pid == 0) {
+			pin_self(cpu, numa);
 			execl("client", "client", to_string(new_id).data(), endpoint.data(), to_string(id).data(), nullptr);
 			throw runtime_error("Can not execl.");
 		}
-		string endpoint = create_endpoint(EndpointType::PARENT_PUB, pid);
-		size_t timeout = 10000; // Время ожидания ответа
-		if (id > new_id) {
-			left_subscriber = new Socket(context, SocketType::SUBSCRIBER, endpoint);
-			zmq_setsockopt(left_subscriber->get_socket(), ZMQ_RCVTIMEO, &timeout, sizeof(timeout)); // Установка предельного времени ожидания сообщения 
-		} 
-		else {
-			right_subscriber = new Socket(context, SocketType::SUBSCRIBER, endpoint);
-			zmq_setsockopt(right_subscriber->get_socket(), ZMQ_RCVTIMEO, &timeout, sizeof(timeout));  // Установка предельного времени ожидания сообщения
-		}
-		return pid;
+		return child_pid;
+	}
+	void pause(int64_t us, function<void()> then) override { // Поток получения просто спит
+		sleep_us(us);
+		then();
+	}
+	void exit_node() override {
+		stop();
+		throw invalid_argument("Exiting child...");
 	}
-	int parent_id; //id родителя
 };
 
-
-void process_msg(Client& client, Message msg) { // Выполнение запроса из сообщения
-	switch(msg.command) {
-		case CommandType::ERROR: {
-			throw runtime_error("Error message received.");
-		}
-		case CommandType::RETURN: { 
-			msg.get_to_id() = SERVER_ID;
-			client.send_up(msg);
-			break;
+void* worker_func(void* client_arg) { // Исполняет задачи из очереди узла
+	Client* client = (Client*) client_arg;
+	Message msg;
+	while (client->jobs.pop(msg)) {
+		if (client->start_job(msg)) {
+			client->finish_job(msg);
 		}
-		case CommandType::CREATE_CHILD: { // Создать ребёнка
-			msg.get_create_id() = client.add_child(msg.get_create_id());
-			msg.get_to_id() = SERVER_ID;
-			client.send_up(msg);
-			break;
-		}
-		case CommandType::REMOVE_CHILD: { // Удалить ребёнка
-			if (msg.to_up) {
-				client.send_up(msg);
-				break;
-			}
-			if (msg.to_id != client.get_id() && msg.to_id != UNIVERSAL_MSG) {
-				client.send_down(msg);
-				break;
-			}
-			msg.get_to_id() = PARENT_SIGNAL;
-			msg.get_create_id() = client.get_id(); 
-			client.send_up(msg);
-			msg.get_to_id() = UNIVERSAL_MSG;
-			client.send_down(msg);
-			client.~Client();
-			throw invalid_argument("Exiting child...");
-			break;
-		}
-		case CommandType::EXEC_CHILD: { // Исполнение команды на вычислительном узле
-			int n = msg.size;
-			msg.sum = 0;
-			for (int i = 0; i < n; i++) {
-				msg.sum += msg.buf[i];
-			}
-			msg.get_to_id() = SERVER_ID;
-			msg.get_create_id() = client.get_id();
-			client.send_up(msg);
-			break;
-		}
-		default:
-			throw runtime_error("Undefined command.");
 	}
+	return nullptr;
 }
 
 Client* client_ptr = nullptr;
 void TerminateByUser(int) { // Завершение работы клиента
 	if (client_ptr != nullptr) {
-		client_ptr->~Client();
+		client_ptr->stop();
 	}
 	cout << to_string(getpid()) + " Terminated by user" << endl;
 	exit(0);
@@ -186,44 +121,36 @@ int main (int argc, char const *argv[]) {
 		Client client(stoi(argv[1]), string(argv[2]), stoi(argv[3])); // Создание клиента
 		client_ptr = &client;
 		cout << getpid() << ": " "Client started. "  << "Id:" << client.get_id() << endl;
-		for (;;) { // Выполнение команд
-			Message msg = client.parent_subscriber->receive();
-			if (msg.to_id != client.get_id() && msg.to_id != UNIVERSAL_MSG) {
-				if (msg.to_up) {
-					client.send_up(msg);
-				} 
+		Message msg; // Одно сообщение переиспользуется на всех итерациях
+		for (;;) { // Маршрутизация: сообщения сверху идут вниз или исполняются, ответы детей идут наверх
+			zmq_pollitem_t items[2];
+			Socket* sources[2] = {client.parent_subscriber, client.children_subscriber};
+			int count = 0;
+			for (Socket* source : sources) {
+				if (source) {
+					items[count++] = {source->get_socket(), 0, ZMQ_POLLIN, 0};
+				}
+			}
+			if (zmq_poll(items, count, client.aggregate_wait_ms()) == -1) {
+				throw runtime_error("Can not poll sockets.");
+			}
+			client.expire_aggregates();
+			for (int i = 0, item = 0; i < 2; i++) {
+				if (!sources[i] || !(items[item++].revents & ZMQ_POLLIN)) {
+					continue;
+				}
+				if (!sources[i]->receive(msg)) {
+					continue;
+				}
+				if (i > 0) {
+					client.from_child(msg);
+				}
 				else {
-					try {
-						if (client.get_id() < msg.to_id) {
-							msg.to_up = false;
-							client.child_publisher_right->send(msg);
-							msg = client.right_subscriber->receive();
-						} 
-						else {
-							msg.to_up = false;
-							client.child_publisher_left->send(msg);
-							msg = client.left_subscriber->receive();
-						}
-						if (msg.command == CommandType::REMOVE_CHILD && msg.to_id == PARENT_SIGNAL) {
-							msg.to_id = SERVER_ID;
-							if (client.get_id() < msg.get_create_id()) {
-								delete client.right_subscriber;
-								client.right_subscriber = nullptr;
-							} 
-							else {
-								delete client.left_subscriber;
-								client.left_subscriber = nullptr;
-							}
-						}
-						client.send_up(msg);
-					}
-					catch (...) {
-						client.send_up(Message());
-					}
+					client.from_parent(msg);
+				}
+				if (i == 0) { // Сообщение сверху могло поменять сокеты детей
+					break;
 				}
-			} 
-			else {
-				process_msg(client, msg);
 			}
 		}
 	} 
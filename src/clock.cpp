@@ -0,0 +1,50 @@
+#include <thread>
+#include "clock.h"
+using namespace std;
+
+#define VIRTUAL_EPOCH_US 1000000 // С чего начинаются виртуальные часы; 0 для срока Message значит «без срока»
+
+class system_clock_source : public clock_source {
+public:
+	time_point now() override {
+		return chrono::steady_clock::now();
+	}
+	void sleep_us(int64_t us) override {
+		this_thread::sleep_for(chrono::microseconds(us));
+	}
+};
+
+static system_clock_source os_clock;
+static atomic<clock_source*> current(&os_clock);
+
+virtual_clock::virtual_clock() : current_us(VIRTUAL_EPOCH_US) {}
+
+time_point virtual_clock::now() {
+	return time_point(chrono::microseconds(current_us.load()));
+}
+
+void virtual_clock::sleep_us(int64_t us) {
+	current_us += us;
+}
+
+void virtual_clock::advance_to(time_point t) {
+	int64_t us = chrono::duration_cast<chrono::microseconds>(t.time_since_epoch()).count();
+	int64_t cur = current_us.load();
+	while (cur < us && !current_us.compare_exchange_weak(cur, us)) {}
+}
+
+void set_clock(clock_source* clock) {
+	current = clock ? clock : &os_clock;
+}
+
+time_point clock_now() {
+	return current.load()->now();
+}
+
+void sleep_us(int64_t us) {
+	current.load()->sleep_us(us);
+}
+
+void sleep_ms(int64_t ms) {
+	sleep_us(ms * 1000);
+}
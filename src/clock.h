@@ -0,0 +1,37 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+typedef chrono::steady_clock::time_point time_point;
+
+// Часы процесса: по ним идут сроки запросов, таймауты и все ожидания.
+// По умолчанию это CLOCK_MONOTONIC и настоящий сон. Стенд sim ставит
+// виртуальные часы: время двигает он сам, а сон только сдвигает время,
+// поэтому прогон с таймаутами в секунды занимает миллисекунды.
+class clock_source {
+public:
+	virtual ~clock_source() {}
+	virtual time_point now() = 0;
+	virtual void sleep_us(int64_t us) = 0;
+};
+
+class virtual_clock : public clock_source {
+public:
+	virtual_clock();
+	time_point now() override;
+	void sleep_us(int64_t us) override; // Время сразу уходит вперёд на us
+	void advance_to(time_point t); // Назад время не идёт
+private:
+	atomic<int64_t> current_us; // От начала эпохи steady_clock
+};
+
+void set_clock(clock_source* clock); // nullptr — снова системные часы
+time_point clock_now();
+void sleep_us(int64_t us);
+void sleep_ms(int64_t ms);
+
+#endif
@@ -0,0 +1,284 @@
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "codec.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+#define FOR_LANES 4 // Полос в блоке, по одной на 32-битную ячейку регистра SSE
+#define FOR_HEADER 5 // Минимум блока (4 байта) и ширина отступа в битах (1 байт)
+
+static int put_varint(uint32_t value, unsigned char* out, int pos, int capacity) { // Новая позиция или -1
+	while (value >= 0x80) {
+		if (pos >= capacity) {
+			return -1;
+		}
+		out[pos++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	if (pos >= capacity) {
+		return -1;
+	}
+	out[pos++] = value;
+	return pos;
+}
+
+static int encode_delta(const int* values, int n, unsigned char* out, int capacity) {
+	uint32_t prev = 0;
+	int pos = 0;
+	for (int i = 0; i < n && pos != -1; i++) {
+		uint32_t delta = (uint32_t)values[i] - prev;
+		prev = values[i];
+		pos = put_varint((delta << 1) ^ (uint32_t)((int32_t)delta >> 31), out, pos, capacity); // zigzag: малые по модулю — малые числа
+	}
+	return pos;
+}
+
+template <class F>
+static void decode_delta(const unsigned char* data, int n, int bytes, F consume) {
+	uint32_t prev = 0;
+	int pos = 0;
+	for (int i = 0; i < n; i++) {
+		uint32_t zigzag = 0;
+		int shift = 0;
+		unsigned char byte;
+		do {
+			if (pos >= bytes) { // Данные оборваны посреди значения
+				return;
+			}
+			byte = data[pos++];
+			zigzag |= (uint32_t)(byte & 0x7f) << shift;
+			shift += 7;
+		} while ((byte & 0x80) && shift < 35);
+		prev += (zigzag >> 1) ^ (0u - (zigzag & 1));
+		consume(i, prev);
+	}
+}
+
+static int block_width(uint32_t max_offset) { // Сколько бит нужно на отступ
+	int width = 0;
+	while (width < 32 && (max_offset >> width) != 0) {
+		width++;
+	}
+	return width;
+}
+
+// Значение j-го шага полосы l лежит в полосе l, начиная с бита j * width.
+// У всех четырёх полос на одном шаге одинаковый сдвиг, поэтому распаковка
+// идёт сразу четырьмя значениями одной командой SSE.
+static int encode_for(const int* values, int n, unsigned char* out, int capacity) {
+	int pos = 0;
+	uint32_t offsets[FOR_BLOCK];
+	uint32_t words[32][FOR_LANES];
+	for (int start = 0; start < n; start += FOR_BLOCK) {
+		int count = n - start < FOR_BLOCK ? n - start : FOR_BLOCK;
+		int32_t low = values[start];
+		for (int i = 1; i < count; i++) {
+			low = values[start + i] < low ? values[start + i] : low;
+		}
+		uint32_t max_offset = 0;
+		for (int i = 0; i < FOR_BLOCK; i++) {
+			offsets[i] = i < count ? (uint32_t)values[start + i] - (uint32_t)low : 0;
+			max_offset |= offsets[i];
+		}
+		int width = block_width(max_offset);
+		if (pos + FOR_HEADER + 4 * FOR_LANES * width > capacity) {
+			return -1;
+		}
+		memcpy(out + pos, &low, 4);
+		out[pos + 4] = width;
+		pos += FOR_HEADER;
+		memset(words, 0, sizeof(words));
+		for (int j = 0, bit = 0; width && j < FOR_BLOCK / FOR_LANES; j++, bit += width) {
+			int word = bit / 32;
+			int shift = bit % 32;
+			for (int l = 0; l < FOR_LANES; l++) {
+				uint32_t offset = offsets[j * FOR_LANES + l];
+				words[word][l] |= offset << shift;
+				if (shift + width > 32) {
+					words[word + 1][l] |= offset >> (32 - shift);
+				}
+			}
+		}
+		memcpy(out + pos, words, 4 * FOR_LANES * width);
+		pos += 4 * FOR_LANES * width;
+	}
+	return pos;
+}
+
+// Распаковывает блок по четыре значения и отдаёт их consume(j, четыре отступа)
+template <class F>
+static void unpack_block(const unsigned char* packed, int width, F consume) {
+	uint32_t mask = width == 32 ? 0xffffffffu : (1u << width) - 1;
+#ifdef __SSE2__
+	__m128i lane_mask = _mm_set1_epi32(mask);
+	for (int j = 0, bit = 0; j < FOR_BLOCK / FOR_LANES; j++, bit += width) {
+		int word = bit / 32;
+		int shift = bit % 32;
+		__m128i value = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)(packed + 16 * word)), _mm_cvtsi32_si128(shift));
+		if (shift + width > 32) {
+			__m128i next = _mm_loadu_si128((const __m128i*)(packed + 16 * (word + 1)));
+			value = _mm_or_si128(value, _mm_sll_epi32(next, _mm_cvtsi32_si128(32 - shift)));
+		}
+		consume(j, _mm_and_si128(value, lane_mask));
+	}
+#else
+	uint32_t words[32][FOR_LANES];
+	memcpy(words, packed, 4 * FOR_LANES * width);
+	for (int j = 0, bit = 0; j < FOR_BLOCK / FOR_LANES; j++, bit += width) {
+		int word = bit / 32;
+		int shift = bit % 32;
+		uint32_t value[FOR_LANES];
+		for (int l = 0; l < FOR_LANES; l++) {
+			value[l] = words[word][l] >> shift;
+			if (shift + width > 32) {
+				value[l] |= words[word + 1][l] << (32 - shift);
+			}
+			value[l] &= mask;
+		}
+		consume(j, value);
+	}
+#endif
+}
+
+static bool for_block_fits(const unsigned char* data, int pos, int bytes) { // Заголовок и упакованные отступы блока не выходят за данные
+	return pos + FOR_HEADER <= bytes && data[pos + 4] <= 32 && pos + FOR_HEADER + 4 * FOR_LANES * data[pos + 4] <= bytes;
+}
+
+static int sum_for(const unsigned char* data, int n, int bytes) {
+	uint32_t sum = 0;
+	int pos = 0;
+	for (int start = 0; start < n; start += FOR_BLOCK) {
+		int count = n - start < FOR_BLOCK ? n - start : FOR_BLOCK;
+		if (!for_block_fits(data, pos, bytes)) {
+			break;
+		}
+		int32_t low;
+		memcpy(&low, data + pos, 4);
+		int width = data[pos + 4];
+		pos += FOR_HEADER;
+		sum += (uint32_t)low * count; // Дополнение последнего блока имеет нулевой отступ
+		if (width == 0) {
+			continue;
+		}
+#ifdef __SSE2__
+		__m128i acc = _mm_setzero_si128();
+		unpack_block(data + pos, width, [&acc](int, __m128i value) { acc = _mm_add_epi32(acc, value); });
+		uint32_t lanes[FOR_LANES];
+		_mm_storeu_si128((__m128i*)lanes, acc);
+		sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+		unpack_block(data + pos, width, [&sum](int, const uint32_t* value) { sum += value[0] + value[1] + value[2] + value[3]; });
+#endif
+		pos += 4 * FOR_LANES * width;
+	}
+	return sum;
+}
+
+static void decode_for(const unsigned char* data, int n, int bytes, int* out) {
+	int pos = 0;
+	for (int start = 0; start < n; start += FOR_BLOCK) {
+		int count = n - start < FOR_BLOCK ? n - start : FOR_BLOCK;
+		if (!for_block_fits(data, pos, bytes)) {
+			break;
+		}
+		int32_t low;
+		memcpy(&low, data + pos, 4);
+		int width = data[pos + 4];
+		pos += FOR_HEADER;
+		if (width == 0) {
+			for (int i = 0; i < count; i++) {
+				out[start + i] = low;
+			}
+			continue;
+		}
+		uint32_t value[FOR_LANES];
+#ifdef __SSE2__
+		unpack_block(data + pos, width, [&](int j, __m128i offsets) {
+			_mm_storeu_si128((__m128i*)value, offsets);
+#else
+		unpack_block(data + pos, width, [&](int j, const uint32_t* offsets) {
+			memcpy(value, offsets, sizeof(value));
+#endif
+			for (int l = 0; l < FOR_LANES && j * FOR_LANES + l < count; l++) {
+				out[start + j * FOR_LANES + l] = (uint32_t)low + value[l];
+			}
+		});
+		pos += 4 * FOR_LANES * width;
+	}
+}
+
+int encode_values(Codec codec, const int* values, int n, unsigned char* out, int capacity) {
+	switch (codec) {
+		case Codec::DELTA_VARINT:
+			return encode_delta(values, n, out, capacity);
+		case Codec::FOR_BITPACK:
+			return encode_for(values, n, out, capacity);
+		default:
+			if (n * (int)sizeof(int) > capacity) {
+				return -1;
+			}
+			memcpy(out, values, n * sizeof(int));
+			return n * sizeof(int);
+	}
+}
+
+void decode_values(Codec codec, const unsigned char* data, int n, int bytes, int* out) {
+	switch (codec) {
+		case Codec::DELTA_VARINT:
+			decode_delta(data, n, bytes, [out](int i, uint32_t value) { out[i] = value; });
+			break;
+		case Codec::FOR_BITPACK:
+			decode_for(data, n, bytes, out);
+			break;
+		default:
+			memcpy(out, data, max(0, min(n, bytes / (int)sizeof(int))) * sizeof(int));
+	}
+}
+
+int decode_sum(Codec codec, const unsigned char* data, int n, int bytes) {
+	uint32_t sum = 0;
+	switch (codec) {
+		case Codec::DELTA_VARINT:
+			decode_delta(data, n, bytes, [&sum](int, uint32_t value) { sum += value; });
+			return sum;
+		case Codec::FOR_BITPACK:
+			return sum_for(data, n, bytes);
+		default:
+			for (int i = 0; i < n && (i + 1) * (int)sizeof(int) <= bytes; i++) {
+				uint32_t value;
+				memcpy(&value, data + i * sizeof(int), sizeof(int));
+				sum += value;
+			}
+			return sum;
+	}
+}
+
+bool parse_codec(const string& name, Codec& codec) {
+	if (name == "raw") {
+		codec = Codec::RAW;
+	}
+	else if (name == "delta") {
+		codec = Codec::DELTA_VARINT;
+	}
+	else if (name == "for") {
+		codec = Codec::FOR_BITPACK;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+string codec_name(Codec codec) {
+	switch (codec) {
+		case Codec::DELTA_VARINT:
+			return "delta";
+		case Codec::FOR_BITPACK:
+			return "for";
+		default:
+			return "raw";
+	}
+}
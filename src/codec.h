@@ -0,0 +1,27 @@
+#ifndef _CODEC_H
+#define _CODEC_H
+
+#include <string>
+using namespace std;
+
+enum struct Codec {
+	RAW, // int подряд, как есть
+	DELTA_VARINT, // Разности соседних значений, zigzag и varint
+	FOR_BITPACK, // Блоки по 128 значений: минимум блока и упакованные отступы от него
+};
+
+#define FOR_BLOCK 128 // Значений в блоке FOR_BITPACK: 4 полосы SIMD по 32 значения
+
+// Кодеки для данных exec. Кодирование возвращает размер в байтах или -1,
+// если результат не помещается в capacity. Декодирование с суммой не
+// распаковывает данные в массив: каждое значение сразу идёт в сумму.
+// Сумма считается по модулю 2^32, как сложение int на узле.
+// Декодирование не читает больше bytes байт data: значения, которые
+// в них не поместились, пропускаются.
+int encode_values(Codec codec, const int* values, int n, unsigned char* out, int capacity);
+void decode_values(Codec codec, const unsigned char* data, int n, int bytes, int* out);
+int decode_sum(Codec codec, const unsigned char* data, int n, int bytes);
+bool parse_codec(const string& name, Codec& codec); // raw, delta, for
+string codec_name(Codec codec);
+
+#endif
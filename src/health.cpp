@@ -0,0 +1,100 @@
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include "health.h"
+using namespace std;
+
+static int self_rss_kb() { // Второе поле /proc/self/statm — резидентные страницы
+	ifstream statm("/proc/self/statm");
+	long size, resident;
+	if (!(statm >> size >> resident)) {
+		return 0;
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int self_cpu_ms() { // utime и stime из /proc/self/stat, в тиках часов
+	ifstream stat("/proc/self/stat");
+	string line;
+	getline(stat, line);
+	size_t end = line.rfind(')'); // Имя процесса может содержать пробелы
+	if (end == string::npos) {
+		return 0;
+	}
+	istringstream fields(line.substr(end + 2));
+	string skip;
+	for (int i = 3; i < 14; i++) { // Поля с 3-го (состояние) по 13-е
+		fields >> skip;
+	}
+	long utime = 0, stime = 0;
+	fields >> utime >> stime;
+	return (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+}
+
+health_report health_report::self(int id, int queue_depth, int jobs_done) {
+	health_report report;
+	report.nodes = 1;
+	report.queue_depth = queue_depth;
+	report.queue_max = queue_depth;
+	report.queue_max_id = id;
+	report.jobs_done = jobs_done;
+	report.rss_kb = self_rss_kb();
+	report.rss_max_kb = report.rss_kb;
+	report.rss_max_id = id;
+	report.cpu_ms = self_cpu_ms();
+	return report;
+}
+
+health_report health_report::read(const int* f, int size) {
+	health_report report;
+	if (size < HEALTH_FIELDS) {
+		return report;
+	}
+	report.nodes = f[0];
+	report.missing = f[1];
+	report.queue_depth = f[2];
+	report.queue_max = f[3];
+	report.queue_max_id = f[4];
+	report.jobs_done = f[5];
+	report.rss_kb = f[6];
+	report.rss_max_kb = f[7];
+	report.rss_max_id = f[8];
+	report.cpu_ms = f[9];
+	return report;
+}
+
+void health_report::merge(const health_report& child) {
+	nodes += child.nodes;
+	missing += child.missing;
+	queue_depth += child.queue_depth;
+	if (child.nodes > 0 && child.queue_max > queue_max) {
+		queue_max = child.queue_max;
+		queue_max_id = child.queue_max_id;
+	}
+	jobs_done += child.jobs_done;
+	rss_kb += child.rss_kb;
+	if (child.nodes > 0 && child.rss_max_kb > rss_max_kb) {
+		rss_max_kb = child.rss_max_kb;
+		rss_max_id = child.rss_max_id;
+	}
+	cpu_ms += child.cpu_ms;
+}
+
+void health_report::write(Message& msg) const {
+	msg.clear_payload();
+	int f[HEALTH_FIELDS] = {nodes, missing, queue_depth, queue_max, queue_max_id, jobs_done, rss_kb, rss_max_kb, rss_max_id, cpu_ms};
+	for (int i = 0; i < HEALTH_FIELDS; i++) {
+		msg.buf[i] = f[i];
+	}
+	msg.size = HEALTH_FIELDS;
+}
+
+string health_report::describe() const {
+	ostringstream line;
+	line << "OK: nodes " << nodes << ", missing subtrees " << missing
+		<< ", queued " << queue_depth << " (max " << queue_max << " on node " << queue_max_id << ")"
+		<< ", jobs done " << jobs_done
+		<< ", RSS " << rss_kb << " kB (max " << rss_max_kb << " kB on node " << rss_max_id << ")"
+		<< ", CPU " << cpu_ms << " ms\n";
+	return line.str();
+}
@@ -0,0 +1,32 @@
+#ifndef _HEALTH_H
+#define _HEALTH_H
+
+#include <string>
+#include "wrap_zmq.h"
+using namespace std;
+
+#define HEALTH_FIELDS 10 // Полей сводки в buf сообщения AGGREGATE
+
+// Сводка здоровья поддерева. Узел начинает со своих счётчиков, добавляет
+// сводки детей и отправляет наверх одну запись, поэтому по каждому ребру
+// дерева проходит одно сообщение, а сервер получает сводку всего дерева.
+struct health_report {
+	int nodes = 0; // Ответивших узлов
+	int missing = 0; // Детей, чьё поддерево не ответило до срока
+	int queue_depth = 0; // Задач в очередях всех узлов
+	int queue_max = 0; // Самая длинная очередь
+	int queue_max_id = 0; // Узел с самой длинной очередью
+	int jobs_done = 0; // Выполнено задач exec
+	int rss_kb = 0; // Резидентная память всех узлов
+	int rss_max_kb = 0; // Больше всего памяти у одного узла
+	int rss_max_id = 0;
+	int cpu_ms = 0; // Процессорное время всех узлов
+
+	static health_report self(int id, int queue_depth, int jobs_done); // Счётчики этого процесса из /proc/self
+	static health_report read(const int* fields, int size); // Сводка из buf ответа; неполная — пустая
+	void merge(const health_report& child);
+	void write(Message& msg) const;
+	string describe() const; // Строка для вывода сервером
+};
+
+#endif
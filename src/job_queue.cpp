@@ -0,0 +1,56 @@
+#include "job_queue.h"
+using namespace std;
+
+job_queue::job_queue(int new_capacity) : capacity(new_capacity), closed(false) {}
+
+bool job_queue::push(const Message& msg) {
+	{
+		lock_guard<mutex> lock(mtx);
+		if (closed || (int)jobs.size() >= capacity) {
+			return false;
+		}
+		jobs.push_back(msg);
+	}
+	not_empty.notify_one();
+	return true;
+}
+
+bool job_queue::pop(Message& msg) {
+	unique_lock<mutex> lock(mtx);
+	not_empty.wait(lock, [this]() { return closed || !jobs.empty(); });
+	if (closed) {
+		return false;
+	}
+	msg = jobs.front();
+	jobs.pop_front();
+	return true;
+}
+
+bool job_queue::remove(int uniq_num, Message& msg) {
+	lock_guard<mutex> lock(mtx);
+	for (auto it = jobs.begin(); it != jobs.end(); it++) {
+		if (it->uniq_num == uniq_num) {
+			msg = *it;
+			jobs.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+void job_queue::close() {
+	{
+		lock_guard<mutex> lock(mtx);
+		closed = true;
+	}
+	not_empty.notify_all();
+}
+
+int job_queue::size() {
+	lock_guard<mutex> lock(mtx);
+	return jobs.size();
+}
+
+int job_queue::get_capacity() {
+	return capacity;
+}
@@ -0,0 +1,29 @@
+#ifndef _JOB_QUEUE_H
+#define _JOB_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "wrap_zmq.h"
+using namespace std;
+
+// Ограниченная очередь задач узла. Поток получения кладёт задачи,
+// поток-исполнитель забирает их по одной.
+class job_queue {
+public:
+	job_queue(int new_capacity);
+	bool push(const Message& msg); // false, если очередь заполнена
+	bool pop(Message& msg); // Ждёт задачу; false, если очередь закрыта
+	void close(); // Будит исполнителя и больше не выдаёт задач
+	bool remove(int uniq_num, Message& msg); // Забирает из очереди ещё не начатую задачу; false, если её там нет
+	int size();
+	int get_capacity();
+private:
+	int capacity; // Наибольшее число ждущих задач
+	bool closed;
+	mutex mtx;
+	condition_variable not_empty;
+	deque<Message> jobs;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+#include "journal.h"
+using namespace std;
+
+#define SNAPSHOT_EVERY 256 // Сколько записей копится в журнале до нового снимка
+
+journal::journal(string new_path) : path(new_path), snapshot_path(new_path + ".snap"), records(0), seq(0) {
+	fd = open(path.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		throw runtime_error("Can not open journal " + path);
+	}
+}
+
+journal::~journal() {
+	close(fd);
+}
+
+void journal::write_record(int out, const journal_record& rec) {
+	if (write(out, &rec, sizeof(rec)) != sizeof(rec)) {
+		throw runtime_error("Can not write journal.");
+	}
+}
+
+void journal::apply(node_index& nodes, const journal_record& rec) {
+	switch (rec.type) {
+		case JournalType::INSERT:
+			nodes.insert(rec.id);
+			break;
+		case JournalType::SET_PID:
+			if (nodes.find(rec.id)) {
+				nodes.get(rec.id)->pid = rec.pid;
+			}
+			break;
+		case JournalType::LISTEN:
+			if (nodes.find(rec.id)) {
+				nodes.get(rec.id)->listen_pid = rec.pid;
+				nodes.get(rec.id)->listen_left = rec.side;
+			}
+			break;
+		case JournalType::DELETE:
+			nodes.delete_el(rec.id);
+			break;
+		case JournalType::REMOVE_NODE:
+			nodes.remove_node(rec.id);
+			break;
+		case JournalType::BIND:
+			add_bind(rec.pid, rec.side);
+			break;
+		case JournalType::SNAPSHOT:
+			break;
+	}
+}
+
+bool journal::add_bind(pid_t pid, int side) {
+	for (auto& it : binds) {
+		if (it.first == pid && it.second == side) {
+			return false;
+		}
+	}
+	binds.emplace_back(pid, side);
+	return true;
+}
+
+bool journal::read_file(const string& file, node_index& nodes, bool is_snapshot) {
+	FILE* in = fopen(file.data(), "rb");
+	if (in == nullptr) {
+		return false;
+	}
+	journal_record rec;
+	while (fread(&rec, sizeof(rec), 1, in) == 1) { // Оборванная последняя запись не читается
+		if (!is_snapshot && rec.seq <= seq) { // Уже есть в снимке
+			continue;
+		}
+		apply(nodes, rec);
+		seq = max(seq, rec.seq);
+		records++;
+	}
+	fclose(in);
+	return true;
+}
+
+bool journal::load(node_index& nodes) {
+	seq = 0;
+	read_file(snapshot_path, nodes, true);
+	records = 0;
+	read_file(path, nodes, false);
+	return nodes.size() > 0;
+}
+
+void journal::append(const node_index& nodes, JournalType type, int id, pid_t pid, int side) {
+	lock_guard<mutex> lock(mtx);
+	add({type, id, pid, side});
+	if (records >= SNAPSHOT_EVERY) {
+		snapshot(nodes);
+	}
+}
+
+void journal::bind(pid_t pid, int side) {
+	lock_guard<mutex> lock(mtx);
+	if (add_bind(pid, side)) {
+		add({JournalType::BIND, 0, pid, side});
+	}
+}
+
+void journal::add(const journal_record& rec) {
+	journal_record numbered = rec;
+	numbered.seq = ++seq;
+	write_record(fd, numbered);
+	records++;
+}
+
+const vector<pair<pid_t, int>>& journal::get_binds() const {
+	return binds;
+}
+
+void journal::snapshot(const node_index& nodes) { // Новый снимок появляется атомарно через rename
+	string tmp = snapshot_path + ".tmp";
+	int out = open(tmp.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out == -1) {
+		throw runtime_error("Can not write snapshot " + tmp);
+	}
+	write_record(out, {JournalType::SNAPSHOT, 0, 0, 0, seq});
+	for (auto& it : binds) {
+		write_record(out, {JournalType::BIND, 0, it.first, it.second, seq});
+	}
+	for (int id : nodes.preorder()) {
+		const node_info* node = nodes.get(id);
+		write_record(out, {JournalType::INSERT, id, 0, 0, seq});
+		write_record(out, {JournalType::SET_PID, id, node->pid, 0, seq});
+		write_record(out, {JournalType::LISTEN, id, node->listen_pid, node->listen_left, seq});
+	}
+	fsync(out);
+	close(out);
+	if (rename(tmp.data(), snapshot_path.data()) == -1) {
+		throw runtime_error("Can not replace snapshot " + snapshot_path);
+	}
+	if (ftruncate(fd, 0) == -1) {
+		throw runtime_error("Can not truncate journal " + path);
+	}
+	records = 0;
+}
+
+void journal::clear() {
+	lock_guard<mutex> lock(mtx);
+	if (ftruncate(fd, 0) == -1) {
+		throw runtime_error("Can not truncate journal " + path);
+	}
+	unlink(snapshot_path.data());
+	binds.clear();
+	records = 0;
+}
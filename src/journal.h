@@ -0,0 +1,60 @@
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "node_index.h"
+using namespace std;
+
+enum struct JournalType {
+	INSERT, // Узел добавлен в дерево
+	SET_PID, // Узел сообщил pid своего процесса
+	LISTEN, // Узел слушает адрес публикации процесса pid со стороны side
+	DELETE, // Узел удалён вместе с поддеревом
+	REMOVE_NODE, // Узел умер, его дети переподвешены
+	BIND, // Сервер занял адрес публикации процесса pid со стороны side
+	SNAPSHOT, // Первая запись снимка: seq — последняя запись журнала, вошедшая в снимок
+};
+
+struct journal_record { // Одна запись журнала, на диске лежит как есть
+	JournalType type;
+	int id;
+	pid_t pid;
+	int side; // Для LISTEN и BIND: 1 — левая сторона
+	long long seq; // Номер изменения; у записей снимка — номер самого снимка
+};
+
+// Журнал изменений дерева на диске. Каждое изменение дописывается одной
+// записью сразу, поэтому журнал переживает падение сервера. Каждые
+// SNAPSHOT_EVERY записей дерево целиком сохраняется в снимок, а журнал
+// обрезается. Записи журнала пронумерованы, а снимок помнит номер последней
+// вошедшей в него записи: если сервер упал между записью снимка и обрезкой
+// журнала, при восстановлении эти записи пропускаются, а не применяются второй раз.
+class journal {
+public:
+	journal(string new_path);
+	~journal();
+	bool load(node_index& nodes); // Снимок плюс журнал; false, если восстанавливать нечего
+	void append(const node_index& nodes, JournalType type, int id, pid_t pid = 0, int side = 0); // nodes — дерево уже после изменения
+	void bind(pid_t pid, int side); // Сервер занял адрес публикации процесса pid
+	const vector<pair<pid_t, int>>& get_binds() const; // Адреса, которые занимал сервер
+	void clear(); // Дерево удалено целиком, восстанавливать нечего
+private:
+	string path; // Журнал
+	string snapshot_path; // Последний снимок
+	int fd; // Журнал, открытый на дозапись
+	int records; // Записей в журнале после последнего снимка
+	long long seq; // Номер последней записанной или применённой записи
+	vector<pair<pid_t, int>> binds; // pid и сторона адресов публикации, занятых сервером
+	mutex mtx; // Изменения дерева пишутся под блокировкой topology, адреса — из потока получения
+	void write_record(int out, const journal_record& rec);
+	void apply(node_index& nodes, const journal_record& rec);
+	bool add_bind(pid_t pid, int side); // false, если адрес уже записан
+	void add(const journal_record& rec); // Дописать в журнал под следующим номером
+	bool read_file(const string& file, node_index& nodes, bool is_snapshot);
+	void snapshot(const node_index& nodes);
+};
+
+#endif
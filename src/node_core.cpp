@@ -0,0 +1,306 @@
+#include <stdexcept>
+#include <algorithm>
+#include "node_core.h"
+using namespace std;
+
+node_core::node_core(void* new_context, int new_id, pid_t new_pid, string parent_endpoint)
+	: jobs(QUEUE_SIZE), jobs_done(0), id(new_id), pid(new_pid), context(new_context) {
+	parent_publisher = new Socket(context, SocketType::PUBLISHER, create_endpoint(EndpointType::PARENT_PUB, pid));
+	parent_subscriber = new Socket(context, SocketType::SUBSCRIBER, parent_endpoint, {ROUTE_ALL, id});
+}
+
+int node_core::get_id() {
+	return id;
+}
+
+pid_t node_core::get_pid() {
+	return pid;
+}
+
+void node_core::from_parent(Message& msg) {
+	if (msg.to_id == id || msg.to_id == UNIVERSAL_MSG) {
+		process(msg);
+	}
+	else if (msg.to_up) {
+		send_up(msg);
+	}
+	else {
+		forward_down(msg);
+	}
+}
+
+void node_core::from_child(Message& msg) {
+	if (msg.command == CommandType::AGGREGATE) {
+		merge_aggregate(msg);
+		return;
+	}
+	if (msg.command != CommandType::REMOVE_CHILD || msg.to_id != PARENT_SIGNAL) {
+		send_up(msg);
+		return;
+	}
+	msg.to_id = SERVER_ID; // Ребёнок удалён
+	send_up(msg);
+	disconnect_child(id < msg.create_id);
+}
+
+void node_core::process(Message& msg) {
+	if (msg.expired() && msg.command != CommandType::EXEC_CHILD && msg.command != CommandType::AGGREGATE) { // Сервер уже ответил TIMEOUT, выполнять запрос поздно
+		return;
+	}
+	switch (msg.command) {
+		case CommandType::ERROR: {
+			throw runtime_error("Error message received.");
+		}
+		case CommandType::RETURN: {
+			reply(msg);
+			break;
+		}
+		case CommandType::CREATE_CHILD: { // Создать ребёнка
+			msg.pid = add_child(msg.get_create_id(), msg.cpu);
+			msg.get_to_id() = SERVER_ID;
+			send_up(msg);
+			break;
+		}
+		case CommandType::REMOVE_CHILD: { // Удалить себя вместе с поддеревом
+			msg.get_to_id() = PARENT_SIGNAL;
+			msg.get_create_id() = id;
+			send_up(msg);
+			msg.get_to_id() = UNIVERSAL_MSG;
+			msg.deadline = 0; // Поддерево удаляется целиком, даже если срок запроса уже вышел
+			send_down(msg);
+			exit_node();
+			break;
+		}
+		case CommandType::ADOPT_CHILD: { // Переподвесить ребёнка умершего узла
+			if (msg.get_create_id() == id) { // Новый родитель подключил этот узел: ответ идёт уже через него
+				reply(msg);
+				break;
+			}
+			adopt_child(msg.get_create_id(), msg.pid, msg.buf[0], msg.buf[1]);
+			msg.get_to_id() = msg.get_create_id();
+			Message done = msg;
+			pause(REJOIN_WAIT, [this, done]() mutable { forward_down(done); }); // Ребёнок тем временем переподключается, потом отвечает сам
+			break;
+		}
+		case CommandType::PROBE: { // Проверка дерева после перезапуска сервера
+			send_down(msg);
+			reply(msg);
+			break;
+		}
+		case CommandType::EXEC_CHILD: { // Исполнение команды на вычислительном узле
+			enqueue(msg);
+			break;
+		}
+		case CommandType::CANCEL: { // Отмена задачи, ещё ждущей в очереди
+			cancel(msg);
+			break;
+		}
+		case CommandType::AGGREGATE: { // Сводка здоровья поддерева
+			start_aggregate(msg);
+			break;
+		}
+		default:
+			throw runtime_error("Undefined command.");
+	}
+}
+
+void node_core::publish(Socket* socket, Message& msg, bool) {
+	socket->send(msg);
+}
+
+void node_core::send_up(Message& msg) {
+	lock_guard<mutex> lock(parent_mutex);
+	msg.to_up = true;
+	publish(parent_publisher, msg, true);
+}
+
+void node_core::send_down(Message& msg) {
+	if (children_publisher == nullptr) { // Лист
+		return;
+	}
+	msg.to_up = false;
+	msg.route = ROUTE_ALL;
+	publish(children_publisher, msg, false);
+}
+
+void node_core::forward_down(Message& msg) {
+	int side = id < msg.to_id;
+	if (child_pids[side] == 0) {
+		msg.command = CommandType::ERROR;
+		msg.error = ErrorType::NO_ROUTE;
+		send_up(msg);
+		return;
+	}
+	msg.to_up = false;
+	msg.route = child_ids[side];
+	publish(children_publisher, msg, false);
+}
+
+void node_core::report_load(Message& msg) {
+	msg.queue_depth = jobs.size();
+	msg.credits = jobs.get_capacity() - msg.queue_depth;
+}
+
+void node_core::reply(Message& msg) {
+	msg.get_to_id() = SERVER_ID;
+	msg.get_create_id() = id;
+	msg.pid = pid; // По любому ответу сервер узнаёт процесс узла
+	report_load(msg);
+	send_up(msg);
+}
+
+void node_core::enqueue(Message& msg) {
+	if (msg.expired()) {
+		drop(msg, ErrorType::EXPIRED);
+		return;
+	}
+	if (!jobs.push(msg)) {
+		msg.error = ErrorType::QUEUE_FULL;
+		reply(msg);
+		return;
+	}
+	job_added();
+}
+
+void node_core::drop(Message& msg, ErrorType error) {
+	msg.error = error;
+	msg.clear_payload();
+	reply(msg);
+}
+
+void node_core::cancel(Message& msg) {
+	Message job;
+	msg.sum = jobs.remove(msg.buf[0], job);
+	if (msg.sum) {
+		drop(job, ErrorType::CANCELLED);
+	}
+	msg.clear_payload();
+	reply(msg);
+}
+
+bool node_core::start_job(Message& msg) {
+	if (msg.expired()) { // Просроченная задача уже никому не нужна
+		drop(msg, ErrorType::EXPIRED);
+		return false;
+	}
+	return true;
+}
+
+void node_core::finish_job(Message& msg) {
+	msg.sum = msg.payload_sum(); // Сжатые данные суммируются прямо при распаковке
+	msg.clear_payload();
+	jobs_done++;
+	reply(msg);
+}
+
+void node_core::start_aggregate(Message& msg) { // Своя сводка; запрос уходит детям, ответ — когда ответят они или выйдет срок
+	health_report report = health_report::self(id, jobs.size(), jobs_done);
+	int waiting = (child_pids[0] != 0) + (child_pids[1] != 0);
+	if (waiting == 0) {
+		report.write(msg);
+		reply(msg);
+		return;
+	}
+	aggregations[msg.uniq_num] = {msg, report, waiting};
+	Message down = msg;
+	if (down.deadline != 0) {
+		down.deadline -= AGGREGATE_MARGIN_US;
+	}
+	send_down(down);
+}
+
+void node_core::merge_aggregate(Message& msg) { // Сводка поддерева ребёнка
+	auto it = aggregations.find(msg.uniq_num);
+	if (it == aggregations.end()) { // Опоздала: сводка уже отправлена без неё
+		return;
+	}
+	it->second.report.merge(health_report::read(msg.buf, msg.size));
+	if (--it->second.waiting == 0) {
+		finish_aggregate(it);
+	}
+}
+
+void node_core::expire_aggregates() {
+	for (auto it = aggregations.begin(); it != aggregations.end(); ) {
+		auto cur = it++;
+		if (cur->second.msg.expired()) {
+			cur->second.report.missing += cur->second.waiting;
+			finish_aggregate(cur);
+		}
+	}
+}
+
+int node_core::aggregate_wait_ms() {
+	int64_t nearest = 0;
+	for (auto& it : aggregations) {
+		int64_t deadline = it.second.msg.deadline;
+		if (deadline != 0 && (nearest == 0 || deadline < nearest)) {
+			nearest = deadline;
+		}
+	}
+	if (nearest == 0) {
+		return -1;
+	}
+	return max<int64_t>(0, (nearest - monotonic_us() + 999) / 1000);
+}
+
+void node_core::finish_aggregate(map<int, aggregation>::iterator it) {
+	Message& msg = it->second.msg;
+	it->second.report.write(msg);
+	reply(msg);
+	aggregations.erase(it);
+}
+
+pid_t node_core::add_child(int new_id, int cpu) {
+	int side = id < new_id;
+	string endpoint = create_endpoint(side ? EndpointType::CHILD_PUB_RIGHT : EndpointType::CHILD_PUB_LEFT, pid);
+	if (!side_bound[side]) { // Адрес занимается до запуска ребёнка, чтобы ему было к чему подключиться
+		bind_children(endpoint);
+		side_bound[side] = true;
+	}
+	pid_t child_pid = spawn(new_id, endpoint, cpu);
+	connect_child(side, new_id, child_pid);
+	return child_pid;
+}
+
+void node_core::bind_children(string endpoint) {
+	if (children_publisher == nullptr) {
+		children_publisher = new Socket(context, SocketType::PUBLISHER, endpoint);
+	}
+	else {
+		children_publisher->attach(endpoint);
+	}
+	children_endpoints.push_back(endpoint);
+}
+
+void node_core::connect_child(int side, int new_child_id, pid_t new_child_pid) {
+	disconnect_child(side);
+	string endpoint = create_endpoint(EndpointType::PARENT_PUB, new_child_pid);
+	if (children_subscriber == nullptr) {
+		children_subscriber = new Socket(context, SocketType::SUBSCRIBER, endpoint);
+	}
+	else {
+		children_subscriber->attach(endpoint);
+	}
+	child_ids[side] = new_child_id;
+	child_pids[side] = new_child_pid;
+}
+
+void node_core::disconnect_child(int side) {
+	if (child_pids[side] == 0) {
+		return;
+	}
+	try {
+		children_subscriber->detach(create_endpoint(EndpointType::PARENT_PUB, child_pids[side]));
+	}
+	catch (runtime_error&) {} // inproc забывает адрес, как только закрылся сокет на другой стороне
+	child_pids[side] = 0;
+}
+
+void node_core::adopt_child(int child_id, pid_t child_pid, pid_t listen_pid, bool listen_left) {
+	// Ребёнок слушает адрес создавшего его родителя и сам переподключится к нему,
+	// как только этот адрес займёт новый родитель
+	bind_children(create_endpoint(listen_left ? EndpointType::CHILD_PUB_LEFT : EndpointType::CHILD_PUB_RIGHT, listen_pid));
+	connect_child(child_id > id, child_id, child_pid);
+	adopted(child_pid);
+}
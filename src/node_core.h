@@ -0,0 +1,85 @@
+#ifndef _NODE_CORE_H
+#define _NODE_CORE_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+#include "wrap_zmq.h"
+#include "socket.h"
+#include "job_queue.h"
+#include "health.h"
+using namespace std;
+
+#define AGGREGATE_MARGIN_US 5000 // Насколько раньше родителя ребёнок отправляет сводку, чтобы она успела подняться
+
+struct aggregation { // Сводка поддерева, ждущая сводок детей
+	Message msg; // Запрос, на который уйдёт ответ
+	health_report report;
+	int waiting; // Сколько детей ещё не ответили
+};
+
+// Маршрутизация и обработка сообщений узла дерева. Её общий код исполняют и
+// процесс client, и узлы стенда sim; наследник даёт только то, чем они
+// различаются: запуск ребёнка, доставку сообщения, ожидание и завершение узла.
+class node_core {
+public:
+	job_queue jobs; // Задачи exec, ждущие исполнения
+	atomic<int> jobs_done; // Выполнено задач exec
+	Socket* parent_publisher;
+	Socket* parent_subscriber;
+	// Сокеты к детям создаются с первым ребёнком. Один PUB на обоих детей привязан
+	// к адресу каждой занятой стороны, ребёнок подписан только на свой id и ROUTE_ALL;
+	// один SUB подключён к адресам обоих детей
+	Socket* children_publisher = nullptr;
+	Socket* children_subscriber = nullptr;
+	int child_ids[2]; // id левого и правого ребёнка
+	pid_t child_pids[2] = {0, 0}; // 0 — ребёнка с этой стороны нет
+	bool side_bound[2] = {false, false}; // Свой адрес стороны уже привязан к children_publisher
+	vector<string> children_endpoints; // Все адреса children_publisher
+	node_core(void* new_context, int new_id, pid_t new_pid, string parent_endpoint); // Сокеты закрывает наследник
+	virtual ~node_core() {}
+	int get_id();
+	pid_t get_pid();
+	void from_parent(Message& msg); // Сообщение сверху: исполнить или передать дальше
+	void from_child(Message& msg); // Ответ от ребёнка уходит наверх
+	bool start_job(Message& msg); // Задача взята из очереди; false, если её срок вышел и узел уже ответил
+	void finish_job(Message& msg); // Результат задачи уходит серверу
+	void expire_aggregates(); // Отправляет сводки с истёкшим сроком; не ответившие дети считаются пропавшими
+	int aggregate_wait_ms(); // Сколько можно ждать сообщений до ближайшего срока сводки; -1 — без срока
+	void drop(Message& msg, ErrorType error); // Задача не будет исполнена: ответ с причиной и без данных
+protected:
+	int id;
+	pid_t pid; // pid процесса узла; в sim — виртуальный
+	void* context;
+	virtual pid_t spawn(int new_id, const string& endpoint, int cpu) = 0; // Запустить ребёнка, слушающего endpoint
+	virtual void publish(Socket* socket, Message& msg, bool up); // Отправить через сокет родителю (up) или детям
+	virtual void pause(int64_t us, function<void()> then) = 0; // Узел занят us мкс, потом выполняет then
+	virtual void adopted(pid_t child_pid) {} // Новый родитель занял адрес, который слушает ребёнок child_pid
+	virtual void exit_node() = 0; // Узел удалён командой REMOVE_CHILD
+	virtual void job_added() {} // В очереди появилась задача
+	void send_up(Message& msg);
+	void send_down(Message& msg); // Обоим детям
+	void forward_down(Message& msg); // Ребёнку на пути к адресату, не дожидаясь ответа
+	void reply(Message& msg); // Ответ серверу от этого узла
+private:
+	mutex parent_mutex; // В сокет родителя пишут поток получения и исполнитель
+	map<int, aggregation> aggregations; // uniq_num -> сводка; трогает только поток получения
+	void process(Message& msg); // Запрос адресован этому узлу
+	void report_load(Message& msg); // Добавляет к ответу загрузку очереди
+	void enqueue(Message& msg); // Ставит задачу в очередь или сразу отказывает
+	void cancel(Message& msg); // Убирает задачу buf[0] из очереди; sum ответа — удалось ли
+	void start_aggregate(Message& msg);
+	void merge_aggregate(Message& msg);
+	void finish_aggregate(map<int, aggregation>::iterator it);
+	pid_t add_child(int new_id, int cpu);
+	void bind_children(string endpoint); // Ещё один адрес канала к детям
+	void connect_child(int side, int new_child_id, pid_t new_child_pid); // Слушать ребёнка; прежний ребёнок этой стороны отключается
+	void disconnect_child(int side);
+	void adopt_child(int child_id, pid_t child_pid, pid_t listen_pid, bool listen_left); // Забрать ребёнка умершего узла, заняв адрес, который он слушает
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include <cstdint>
+#include "node_index.h"
+using namespace std;
+
+#define EMPTY_CELL -1
+#define DELETED_CELL -2
+
+node_index::node_index() : root(NO_NODE), tombstones(0) {
+	table.assign(16, EMPTY_CELL);
+}
+
+size_t node_index::probe(int id) const { // Линейное пробирование
+	uint32_t h = (uint32_t)id * 2654435761u;
+	size_t mask = table.size() - 1;
+	size_t i = (h ^ (h >> 16)) & mask;
+	size_t first_deleted = table.size();
+	for (;; i = (i + 1) & mask) {
+		int cell = table[i];
+		if (cell == EMPTY_CELL) {
+			return first_deleted != table.size() ? first_deleted : i;
+		}
+		if (cell == DELETED_CELL) {
+			if (first_deleted == table.size()) {
+				first_deleted = i;
+			}
+		}
+		else if (nodes[cell].id == id) {
+			return i;
+		}
+	}
+}
+
+int node_index::lookup(int id) const {
+	int cell = table[probe(id)];
+	if (cell >= 0 && nodes[cell].id == id) {
+		return cell;
+	}
+	return NO_NODE;
+}
+
+void node_index::rehash(size_t capacity) {
+	table.assign(capacity, EMPTY_CELL);
+	tombstones = 0;
+	for (size_t i = 0; i < ids.size(); i++) {
+		table[probe(ids[i])] = slots[i];
+	}
+}
+
+bool node_index::find(int id) const { // Поиск элемента
+	return lookup(id) != NO_NODE;
+}
+
+node_info* node_index::get(int id) {
+	int slot = lookup(id);
+	return slot == NO_NODE ? nullptr : &nodes[slot];
+}
+
+const node_info* node_index::get(int id) const {
+	int slot = lookup(id);
+	return slot == NO_NODE ? nullptr : &nodes[slot];
+}
+
+int node_index::size() const {
+	return ids.size();
+}
+
+const vector<int>& node_index::get_all_elems() const {
+	return ids;
+}
+
+int node_index::get_place(int id) const { // Возвращает значение элемента родителя
+	int cur = root;
+	while (cur != NO_NODE) {
+		const node_info& node = nodes[cur];
+		int next;
+		if (id < node.id) {
+			next = node.left;
+		}
+		else if (id > node.id) {
+			next = node.right;
+		}
+		else {
+			return -1;
+		}
+		if (next == NO_NODE) {
+			return node.id;
+		}
+		cur = next;
+	}
+	return -1;
+}
+
+void node_index::insert(int id) { // Добавить элемент
+	if (find(id)) {
+		return;
+	}
+	if ((ids.size() + tombstones + 1) * 2 > table.size()) {
+		rehash((ids.size() + 1) * 4 > table.size() ? table.size() * 2 : table.size());
+	}
+	int parent = NO_NODE;
+	int cur = root;
+	while (cur != NO_NODE) {
+		parent = cur;
+		cur = id < nodes[cur].id ? nodes[cur].left : nodes[cur].right;
+	}
+	int slot;
+	if (!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+	else {
+		slot = nodes.size();
+		nodes.emplace_back();
+	}
+	node_info& node = nodes[slot];
+	node.id = id;
+	node.parent = parent;
+	node.left = NO_NODE;
+	node.right = NO_NODE;
+	node.depth = parent == NO_NODE ? 0 : nodes[parent].depth + 1;
+	node.pos = ids.size();
+	node.pid = 0;
+	node.listen_pid = 0;
+	node.listen_left = false;
+	ids.push_back(id);
+	slots.push_back(slot);
+	size_t cell = probe(id);
+	if (table[cell] == DELETED_CELL) {
+		tombstones--;
+	}
+	table[cell] = slot;
+	if (parent == NO_NODE) {
+		root = slot;
+	}
+	else if (id < nodes[parent].id) {
+		nodes[parent].left = slot;
+	}
+	else {
+		nodes[parent].right = slot;
+	}
+}
+
+void node_index::erase_slot(int slot) { // Убирает узел из таблицы и списка элементов
+	node_info& node = nodes[slot];
+	table[probe(node.id)] = DELETED_CELL;
+	tombstones++;
+	int last = ids.size() - 1;
+	ids[node.pos] = ids[last];
+	slots[node.pos] = slots[last];
+	nodes[slots[node.pos]].pos = node.pos;
+	ids.pop_back();
+	slots.pop_back();
+	free_slots.push_back(slot);
+}
+
+void node_index::delete_el(int id) { // Удалить элемент вместе с поддеревом
+	int slot = lookup(id);
+	if (slot == NO_NODE) {
+		return;
+	}
+	int parent = nodes[slot].parent;
+	if (parent == NO_NODE) {
+		root = NO_NODE;
+	}
+	else if (nodes[parent].left == slot) {
+		nodes[parent].left = NO_NODE;
+	}
+	else {
+		nodes[parent].right = NO_NODE;
+	}
+	stack.push_back(slot);
+	while (!stack.empty()) {
+		int cur = stack.back();
+		stack.pop_back();
+		if (nodes[cur].left != NO_NODE) {
+			stack.push_back(nodes[cur].left);
+		}
+		if (nodes[cur].right != NO_NODE) {
+			stack.push_back(nodes[cur].right);
+		}
+		erase_slot(cur);
+	}
+}
+
+bool node_index::is_root(int id) const {
+	int slot = lookup(id);
+	return slot != NO_NODE && slot == root;
+}
+
+int node_index::get_root() const {
+	return root == NO_NODE ? NO_NODE : nodes[root].id;
+}
+
+vector<int> node_index::preorder() const {
+	vector<int> order;
+	order.reserve(ids.size());
+	vector<int> pending;
+	if (root != NO_NODE) {
+		pending.push_back(root);
+	}
+	while (!pending.empty()) {
+		int cur = pending.back();
+		pending.pop_back();
+		order.push_back(nodes[cur].id);
+		if (nodes[cur].right != NO_NODE) {
+			pending.push_back(nodes[cur].right);
+		}
+		if (nodes[cur].left != NO_NODE) {
+			pending.push_back(nodes[cur].left);
+		}
+	}
+	return order;
+}
+
+int node_index::get_parent_id(int id) const {
+	return nodes[nodes[lookup(id)].parent].id;
+}
+
+void node_index::attach(int slot, int parent) {
+	nodes[slot].parent = parent;
+	if (parent == NO_NODE) {
+		root = slot;
+	}
+	else if (nodes[slot].id < nodes[parent].id) {
+		nodes[parent].left = slot;
+	}
+	else {
+		nodes[parent].right = slot;
+	}
+	stack.push_back(slot);
+	while (!stack.empty()) {
+		int cur = stack.back();
+		stack.pop_back();
+		int p = nodes[cur].parent;
+		nodes[cur].depth = p == NO_NODE ? 0 : nodes[p].depth + 1;
+		if (nodes[cur].left != NO_NODE) {
+			stack.push_back(nodes[cur].left);
+		}
+		if (nodes[cur].right != NO_NODE) {
+			stack.push_back(nodes[cur].right);
+		}
+	}
+}
+
+// Левый ребёнок встаёт на место удалённого узла, а правое поддерево
+// подвешивается справа к максимальному элементу левого. Порядок ключей
+// не меняется, поэтому маршрутизация по сравнению id остаётся верной.
+vector<int> node_index::remove_node(int id) {
+	vector<int> moved;
+	int slot = lookup(id);
+	if (slot == NO_NODE) {
+		return moved;
+	}
+	int parent = nodes[slot].parent;
+	int left = nodes[slot].left;
+	int right = nodes[slot].right;
+	if (parent == NO_NODE) {
+		root = NO_NODE;
+	}
+	else if (nodes[parent].left == slot) {
+		nodes[parent].left = NO_NODE;
+	}
+	else {
+		nodes[parent].right = NO_NODE;
+	}
+	erase_slot(slot);
+	if (left != NO_NODE) {
+		attach(left, parent);
+		moved.push_back(nodes[left].id);
+		if (right != NO_NODE) {
+			int max_left = left;
+			while (nodes[max_left].right != NO_NODE) {
+				max_left = nodes[max_left].right;
+			}
+			attach(right, max_left);
+			moved.push_back(nodes[right].id);
+		}
+	}
+	else if (right != NO_NODE) {
+		attach(right, parent);
+		moved.push_back(nodes[right].id);
+	}
+	return moved;
+}
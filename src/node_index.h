@@ -0,0 +1,57 @@
+#ifndef _NODE_INDEX_H
+#define _NODE_INDEX_H
+
+#include <vector>
+#include <sys/types.h>
+using namespace std;
+
+#define NO_NODE -1
+
+struct node_info { // Сведения об узле
+	int id; // id узла
+	int parent; // Слот родителя
+	int left; // Слот левого ребёнка
+	int right; // Слот правого ребёнка
+	int depth; // Глубина, у корня 0
+	int pos; // Позиция id в списке всех элементов
+	pid_t pid; // pid процесса узла
+	pid_t listen_pid; // Чей адрес публикации слушает узел: процесс, который его создал; переподвешивание его не меняет
+	bool listen_left; // Сторона этого адреса
+};
+
+// Плоский индекс узлов: метаданные лежат подряд в одном массиве, связи между
+// узлами хранятся номерами слотов, поиск по id идёт через хеш-таблицу
+// с открытой адресацией. Ни одна операция не рекурсивна, поиск не выделяет память.
+class node_index {
+public:
+	node_index();
+	bool find(int id) const; // Проверка, есть ли такой элемент в дереве
+	void insert(int id); // Добавить элемент в дерево
+	void delete_el(int id); // Удалить элемент вместе с поддеревом
+	vector<int> remove_node(int id); // Удалить только сам элемент, его детей переподвесить; возвращает id переподвешенных
+	bool is_root(int id) const;
+	int get_root() const; // id корня или NO_NODE, если дерево пусто
+	vector<int> preorder() const; // id в прямом порядке: вставка в этом порядке восстанавливает ту же форму дерева
+	int get_parent_id(int id) const; // id родителя существующего элемента (у корня не определён)
+	int get_place(int id) const; // Возвращает значение элемента родителя
+	const vector<int>& get_all_elems() const; // Список всех элементов, без копирования
+	node_info* get(int id); // Метаданные узла или nullptr
+	const node_info* get(int id) const;
+	int size() const;
+private:
+	vector<node_info> nodes; // Слоты узлов
+	vector<int> free_slots; // Освободившиеся слоты
+	vector<int> ids; // id всех узлов подряд
+	vector<int> slots; // Слоты узлов в том же порядке, что и ids
+	vector<int> table; // Хеш-таблица id -> слот
+	vector<int> stack; // Рабочий стек для удаления поддерева
+	int root; // Слот корня
+	int tombstones; // Удалённые ячейки хеш-таблицы
+	int lookup(int id) const; // Слот узла или NO_NODE
+	size_t probe(int id) const; // Ячейка таблицы, где лежит или должен лежать id
+	void rehash(size_t capacity);
+	void erase_slot(int slot);
+	void attach(int slot, int parent); // Подвешивает поддерево slot к parent и пересчитывает глубины
+};
+
+#endif
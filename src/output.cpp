@@ -0,0 +1,80 @@
+#include <sched.h>
+#include <stdexcept>
+#include "output.h"
+using namespace std;
+
+#define OUTPUT_WAIT_MS 10 // Сколько писатель спит на пустой очереди
+
+output_writer::output_writer(FILE* new_out, size_t capacity) : out(new_out), fast(capacity), has_slow(false), has_fast_producer(false), running(false) {}
+
+void output_writer::start() {
+	running = true;
+	if (pthread_create(&thread, 0, writer_func, this) != 0) {
+		throw runtime_error("Can not run output thread.");
+	}
+}
+
+void output_writer::stop() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	pthread_join(thread, NULL);
+	drain();
+	flush();
+}
+
+void output_writer::set_fast_producer() {
+	fast_producer = pthread_self();
+	has_fast_producer = true;
+}
+
+void output_writer::print(const string& line) {
+	if (!running) { // Поток вывода ещё не запущен или уже остановлен
+		fputs(line.data(), out);
+		fflush(out);
+		return;
+	}
+	if (has_fast_producer && pthread_equal(fast_producer, pthread_self())) {
+		while (!fast.push(line)) { // Консоль не успевает: поток разбора ждёт, а не теряет строки
+			sched_yield();
+		}
+		return;
+	}
+	lock_guard<mutex> lock(slow_mutex);
+	slow.push_back(line);
+	has_slow = true;
+}
+
+void output_writer::drain() {
+	for (string* line = fast.front(); line != nullptr; line = fast.front()) {
+		batch += *line;
+		fast.pop();
+	}
+	if (has_slow) {
+		lock_guard<mutex> lock(slow_mutex);
+		for (string& line : slow) {
+			batch += line;
+		}
+		slow.clear();
+		has_slow = false;
+	}
+}
+
+void output_writer::flush() {
+	if (batch.empty()) {
+		return;
+	}
+	fwrite(batch.data(), 1, batch.size(), out);
+	fflush(out);
+	batch.clear();
+}
+
+void* output_writer::writer_func(void* writer) {
+	output_writer* w = (output_writer*) writer;
+	while (w->running) {
+		w->fast.wait_front(OUTPUT_WAIT_MS);
+		w->drain();
+		w->flush();
+	}
+	return nullptr;
+}
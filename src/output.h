@@ -0,0 +1,40 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <pthread.h>
+#include "spsc_queue.h"
+using namespace std;
+
+// Вывод сервера в отдельном потоке. Поток разбора ответов пишет строки
+// в очередь без блокировок, остальные потоки — под мьютексом. Писатель
+// собирает всё накопившееся и выводит одним вызовом, так что медленная
+// консоль не тормозит разбор ответов.
+class output_writer {
+public:
+	output_writer(FILE* new_out, size_t capacity);
+	void start(); // Запустить поток вывода
+	void stop(); // Вывести оставшееся и остановить поток
+	void set_fast_producer(); // Вызывающий поток будет писать через очередь без блокировок
+	void print(const string& line); // Строка выводится целиком, перевод строки добавляет вызывающий
+private:
+	FILE* out;
+	spsc_queue<string> fast; // Строки потока разбора ответов
+	mutex slow_mutex;
+	vector<string> slow; // Строки остальных потоков
+	atomic<bool> has_slow;
+	pthread_t fast_producer;
+	atomic<bool> has_fast_producer;
+	atomic<bool> running;
+	pthread_t thread;
+	string batch; // Накопленный вывод
+	static void* writer_func(void* writer);
+	void drain(); // Переносит всё накопившееся в batch
+	void flush();
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include <vector>
+#include "pending.h"
+#include "health.h"
+using namespace std;
+
+#define SWEEP_INTERVAL_MS 10 // Как часто expire просматривает все запросы
+
+pending_requests::pending_requests() : next_sweep(clock_now()) {}
+
+void pending_requests::add(const Message& msg, reply_handler handler, int timeout_ms) {
+	request req;
+	req.command = msg.command;
+	req.id = msg.to_id;
+	req.timed = timeout_ms > 0;
+	req.deadline = clock_now() + chrono::milliseconds(timeout_ms);
+	req.handler = move(handler);
+	lock_guard<mutex> lock(mtx);
+	requests[msg.uniq_num] = move(req);
+}
+
+void pending_requests::finish(request& req, request_result& result) {
+	result.command = req.command;
+	if (req.handler) {
+		req.handler(result);
+	}
+}
+
+bool pending_requests::take(int uniq_num, request& req) {
+	lock_guard<mutex> lock(mtx);
+	auto it = requests.find(uniq_num);
+	if (it == requests.end()) {
+		return false;
+	}
+	req = move(it->second);
+	requests.erase(it);
+	return true;
+}
+
+bool pending_requests::resolve(const Message& reply) {
+	request req;
+	if (!take(reply.uniq_num, req)) {
+		return false;
+	}
+	request_result result;
+	result.request = reply.uniq_num;
+	if (reply.command == CommandType::ERROR) { // Сообщение не дошло до узла to_id
+		result.id = reply.to_id;
+		result.error = reply.error == ErrorType::NONE ? ErrorType::NO_ROUTE : reply.error;
+	}
+	else {
+		result.id = reply.create_id;
+		result.error = reply.error;
+	}
+	result.pid = reply.pid;
+	result.sum = reply.sum;
+	if (reply.codec == Codec::RAW && reply.size > 0) {
+		result.data.assign(reply.buf, reply.buf + min(reply.size, MAX_SIZE));
+	}
+	finish(req, result);
+	return true;
+}
+
+void pending_requests::expire() {
+	time_point now = clock_now();
+	vector<pair<int, request>> expired;
+	{
+		lock_guard<mutex> lock(mtx);
+		if (now < next_sweep) {
+			return;
+		}
+		next_sweep = now + chrono::milliseconds(SWEEP_INTERVAL_MS);
+		for (auto it = requests.begin(); it != requests.end();) {
+			if (it->second.timed && it->second.deadline <= now) {
+				expired.emplace_back(it->first, move(it->second));
+				it = requests.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+	}
+	for (auto& it : expired) {
+		request_result result;
+		result.id = it.second.id;
+		result.error = ErrorType::TIMEOUT;
+		result.request = it.first;
+		finish(it.second, result);
+	}
+}
+
+bool pending_requests::cancel(int uniq_num) {
+	request req;
+	if (!take(uniq_num, req)) {
+		return false;
+	}
+	request_result result;
+	result.id = req.id;
+	result.error = ErrorType::CANCELLED;
+	result.request = uniq_num;
+	finish(req, result);
+	return true;
+}
+
+void pending_requests::arm(int uniq_num, int timeout_ms) {
+	lock_guard<mutex> lock(mtx);
+	auto it = requests.find(uniq_num);
+	if (it == requests.end() || it->second.timed) {
+		return;
+	}
+	it->second.timed = true;
+	it->second.deadline = clock_now() + chrono::milliseconds(timeout_ms);
+}
+
+int pending_requests::size() {
+	lock_guard<mutex> lock(mtx);
+	return requests.size();
+}
+
+static const char* command_name(CommandType command) {
+	switch (command) {
+		case CommandType::CREATE_CHILD:
+			return "create";
+		case CommandType::REMOVE_CHILD:
+			return "remove";
+		case CommandType::EXEC_CHILD:
+			return "exec";
+		case CommandType::CANCEL:
+			return "cancel";
+		case CommandType::AGGREGATE:
+			return "aggregate";
+		default:
+			return "check";
+	}
+}
+
+void pending_requests::print(ostream& out) {
+	time_point now = clock_now();
+	lock_guard<mutex> lock(mtx);
+	out << "Pending requests: " << requests.size() << "\n";
+	for (auto& it : requests) {
+		out << "Request " << it.first << ": " << command_name(it.second.command);
+		if (it.second.timed) {
+			out << ", " << chrono::duration_cast<chrono::milliseconds>(it.second.deadline - now).count() << " ms left";
+		}
+		out << "\n";
+	}
+}
+
+string describe(const request_result& result) {
+	if (result.error == ErrorType::TIMEOUT) {
+		return "Error:" + to_string(result.id) + ":Node didn't answer in time.\n";
+	}
+	if (result.error == ErrorType::NO_ROUTE) {
+		return "Error:" + to_string(result.id) + ":Node is unreachable.\n";
+	}
+	if (result.error == ErrorType::QUEUE_FULL) {
+		return "Error:" + to_string(result.id) + ":Node queue is full.\n";
+	}
+	if (result.error == ErrorType::EXPIRED) {
+		return "Error:" + to_string(result.id) + ":Request " + to_string(result.request) + " expired before it started.\n";
+	}
+	if (result.error == ErrorType::CANCELLED) {
+		return "Error:" + to_string(result.id) + ":Request " + to_string(result.request) + " cancelled.\n";
+	}
+	if (result.command == CommandType::AGGREGATE) {
+		return health_report::read(result.data.data(), result.data.size()).describe();
+	}
+	if (result.command == CommandType::CANCEL && !result.sum) {
+		return "Error:" + to_string(result.id) + ":Request is already running or done.\n";
+	}
+	if (result.command == CommandType::CREATE_CHILD) {
+		return "OK:" + to_string(result.pid) + "\n";
+	}
+	if (result.command == CommandType::EXEC_CHILD) {
+		return "OK:" + to_string(result.id) + ":" + to_string(result.sum) + "\n";
+	}
+	return "OK\n";
+}
@@ -0,0 +1,56 @@
+#ifndef _PENDING_H
+#define _PENDING_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+#include <unordered_map>
+#include "wrap_zmq.h"
+#include "clock.h"
+using namespace std;
+
+struct request_result { // Ответ на запрос к узлу
+	CommandType command; // Что запрашивали
+	int id; // Узел, который ответил или не ответил
+	ErrorType error = ErrorType::NONE; // Почему запрос не выполнен
+	pid_t pid = 0; // pid созданного узла
+	int sum = 0; // Результат exec; для CANCEL — удалось ли отменить
+	int request = 0; // uniq_num запроса
+	vector<int> data; // Данные ответа, например сводка AGGREGATE
+};
+
+typedef function<void(const request_result&)> reply_handler;
+
+string describe(const request_result& result); // Строка ответа на команду пользователя
+
+// Запросы, отправленные узлам и ещё не получившие ответа, по uniq_num.
+// Ответ или истечение срока вызывает обработчик запроса ровно один раз,
+// вне блокировки, поэтому обработчик может сам отправлять новые запросы.
+class pending_requests {
+public:
+	pending_requests();
+	void add(const Message& msg, reply_handler handler, int timeout_ms); // timeout_ms == 0 — ждать без срока
+	bool resolve(const Message& reply); // Ответ узла; false, если запрос не ждали
+	void expire(); // Завершает запросы с истёкшим сроком ошибкой TIMEOUT
+	bool cancel(int uniq_num); // Завершает запрос ошибкой CANCELLED; false, если запрос не ждали
+	void arm(int uniq_num, int timeout_ms); // Запросу без срока — срок timeout_ms с этого момента
+	int size();
+	void print(ostream& out); // Запросы, ждущие ответа, и сколько им осталось
+private:
+	struct request { // Запрос, ждущий ответа
+		CommandType command;
+		int id;
+		time_point deadline;
+		bool timed; // Есть ли у запроса срок
+		reply_handler handler;
+	};
+	mutex mtx;
+	unordered_map<int, request> requests; // uniq_num -> запрос
+	time_point next_sweep; // Раньше этого времени expire не просматривает запросы
+	void finish(request& req, request_result& result); // Вызывает обработчик
+	bool take(int uniq_num, request& req); // Забирает запрос из ожидающих
+};
+
+#endif
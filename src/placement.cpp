@@ -0,0 +1,219 @@
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include "placement.h"
+using namespace std;
+
+#define SYSFS_CPU "/sys/devices/system/cpu/cpu" // Каталог ядра в sysfs, к нему дописывается номер
+#define MAX_NUMA_NODES 1024 // Размер маски узлов для set_mempolicy
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1 // Память по возможности с заданного узла NUMA, иначе с любого
+#endif
+
+static int read_first_int(const string& path) { // Первое число файла sysfs или -1
+	ifstream in(path);
+	int value;
+	if (!(in >> value)) {
+		return -1;
+	}
+	return value;
+}
+
+static int cpu_l3(int cpu) { // Группа ядер с общим L3: id кэша или первое ядро, которое его делит
+	string cache = SYSFS_CPU + to_string(cpu) + "/cache/index";
+	for (int index = 0; ; index++) {
+		int level = read_first_int(cache + to_string(index) + "/level");
+		if (level == -1) {
+			return -1;
+		}
+		if (level == 3) {
+			int id = read_first_int(cache + to_string(index) + "/id");
+			return id != -1 ? id : read_first_int(cache + to_string(index) + "/shared_cpu_list");
+		}
+	}
+}
+
+int cpu_numa_node(int cpu) {
+	if (cpu < 0) {
+		return -1;
+	}
+	DIR* dir = opendir((SYSFS_CPU + to_string(cpu)).data());
+	if (dir == nullptr) {
+		return -1;
+	}
+	int node = -1;
+	for (dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4])) {
+			node = atoi(entry->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+void pin_self(int cpu, int numa) {
+	if (cpu < 0) {
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set); // Привязка и политика памяти сохраняются после execl
+	if (numa >= 0 && numa < MAX_NUMA_NODES) {
+		unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {};
+		mask[numa / (8 * sizeof(unsigned long))] |= 1ul << (numa % (8 * sizeof(unsigned long)));
+		syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAX_NUMA_NODES + 1);
+	}
+}
+
+bool parse_pin_policy(const string& name, PinPolicy& policy) {
+	if (name == "none") {
+		policy = PinPolicy::NONE;
+	}
+	else if (name == "shared") {
+		policy = PinPolicy::SHARED;
+	}
+	else if (name == "exclusive") {
+		policy = PinPolicy::EXCLUSIVE;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+string pin_policy_name(PinPolicy policy) {
+	switch (policy) {
+		case PinPolicy::SHARED:
+			return "shared";
+		case PinPolicy::EXCLUSIVE:
+			return "exclusive";
+		default:
+			return "none";
+	}
+}
+
+placement::placement(PinPolicy new_policy) : policy(new_policy) {
+	if (policy == PinPolicy::NONE) {
+		return;
+	}
+	cpu_set_t allowed; // Только ядра, на которых разрешено работать серверу, например внутри cpuset
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		throw runtime_error("Can not read CPU affinity.");
+	}
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			continue;
+		}
+		cpu_info info;
+		info.cpu = cpu;
+		info.node = cpu_numa_node(cpu);
+		info.l3 = cpu_l3(cpu);
+		if (info.l3 == -1) { // Нет сведений о кэше: считаем общим кэш узла NUMA
+			info.l3 = info.node;
+		}
+		cpus.push_back(info);
+	}
+}
+
+int placement::pick(int parent_slot) {
+	int best = -1;
+	int best_distance = 0;
+	for (int i = 0; i < (int)cpus.size(); i++) {
+		if (policy == PinPolicy::EXCLUSIVE && cpus[i].load > 0) {
+			continue;
+		}
+		int distance = 2; // 0 — общий L3 с родителем, 1 — тот же узел NUMA, 2 — дальше
+		if (parent_slot != -1 && cpus[i].l3 == cpus[parent_slot].l3) {
+			distance = 0;
+		}
+		else if (parent_slot != -1 && cpus[i].node == cpus[parent_slot].node) {
+			distance = 1;
+		}
+		// Сначала наименее загруженное ядро, чтобы не копить узлы в одном L3, затем ближайшее к родителю
+		if (best == -1 || cpus[i].load < cpus[best].load || (cpus[i].load == cpus[best].load && distance < best_distance)) {
+			best = i;
+			best_distance = distance;
+		}
+	}
+	return best;
+}
+
+int placement::assign(int id, int parent) {
+	if (policy == PinPolicy::NONE) {
+		return -1;
+	}
+	lock_guard<mutex> lock(mtx);
+	auto it = placed.find(parent);
+	int slot = pick(it == placed.end() ? -1 : it->second);
+	if (slot == -1) {
+		return -1;
+	}
+	auto old = placed.find(id); // Повторное создание узла с тем же id
+	if (old != placed.end()) {
+		cpus[old->second].load--;
+	}
+	placed[id] = slot;
+	cpus[slot].load++;
+	return cpus[slot].cpu;
+}
+
+void placement::adopt(int id, pid_t pid) {
+	if (policy == PinPolicy::NONE || pid <= 0) {
+		return;
+	}
+	cpu_set_t set;
+	if (sched_getaffinity(pid, sizeof(set), &set) != 0 || CPU_COUNT(&set) != 1) { // Процесс умер или не привязан
+		return;
+	}
+	lock_guard<mutex> lock(mtx);
+	for (int i = 0; i < (int)cpus.size(); i++) {
+		if (CPU_ISSET(cpus[i].cpu, &set)) {
+			placed[id] = i;
+			cpus[i].load++;
+			return;
+		}
+	}
+}
+
+void placement::retain(const function<bool(int)>& exists) {
+	lock_guard<mutex> lock(mtx);
+	for (auto it = placed.begin(); it != placed.end(); ) {
+		if (exists(it->first)) {
+			++it;
+			continue;
+		}
+		cpus[it->second].load--;
+		it = placed.erase(it);
+	}
+}
+
+int placement::numa_node(int cpu) const {
+	for (const cpu_info& info : cpus) {
+		if (info.cpu == cpu) {
+			return info.node;
+		}
+	}
+	return -1;
+}
+
+PinPolicy placement::get_policy() const {
+	return policy;
+}
+
+void placement::print_stats(ostream& out) {
+	lock_guard<mutex> lock(mtx);
+	out << "Pinning: " << pin_policy_name(policy) << ", pinned nodes: " << placed.size() << "\n";
+	for (const cpu_info& info : cpus) {
+		if (info.load > 0) {
+			out << "CPU " << info.cpu << " (L3 " << info.l3 << ", NUMA " << info.node << "): nodes " << info.load << "\n";
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef _PLACEMENT_H
+#define _PLACEMENT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <sys/types.h>
+using namespace std;
+
+enum struct PinPolicy {
+	NONE, // Узлы не привязываются, ядра выбирает планировщик ОС
+	SHARED, // Узел на наименее загруженном ядре, по возможности с общим L3 с родителем
+	EXCLUSIVE, // Узел один на своём ядре; когда свободных ядер нет, узел не привязывается
+};
+
+struct cpu_info {
+	int cpu; // Номер ядра
+	int l3; // Группа ядер с общим L3
+	int node; // Узел NUMA
+	int load = 0; // Сколько узлов дерева привязано к ядру
+};
+
+// Размещение узлов дерева по ядрам. Сервер выбирает ядро при создании узла
+// и передаёт его в CREATE_CHILD; родитель узнаёт узел NUMA этого ядра до fork,
+// а ребёнок привязывается к ядру и памяти узла NUMA перед execl.
+class placement {
+public:
+	placement(PinPolicy new_policy); // Читает ядра, доступные серверу, и их кэши из sysfs
+	int assign(int id, int parent); // Ядро для нового узла или -1; parent == -1 для корня
+	void adopt(int id, pid_t pid); // Узел прошлого запуска: ядро берётся из привязки его процесса
+	void retain(const function<bool(int)>& exists); // Освобождает ядра узлов, которых больше нет в дереве
+	int numa_node(int cpu) const; // Узел NUMA ядра или -1
+	PinPolicy get_policy() const;
+	void print_stats(ostream& out);
+private:
+	PinPolicy policy;
+	vector<cpu_info> cpus;
+	map<int, int> placed; // id узла -> индекс в cpus
+	mutex mtx;
+	int pick(int parent_slot); // Индекс ядра в cpus или -1
+};
+
+bool parse_pin_policy(const string& name, PinPolicy& policy); // none, shared, exclusive
+string pin_policy_name(PinPolicy policy);
+int cpu_numa_node(int cpu); // Узел NUMA ядра по sysfs или -1
+void pin_self(int cpu, int numa); // Только системные вызовы: безопасно между fork и execl
+
+#endif
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Перезапуск сервера с живыми узлами: строит дерево, убивает сервер и запускает его снова.
+# Второй запуск должен найти дерево по журналу и ответить на команды через старые узлы.
+# ./restart.sh              — сервер убивается SIGKILL
+# SIG=TERM ./restart.sh     — сигнал, который сервер обрабатывает сам; узлы тоже остаются
+# KILL=7 ./restart.sh       — пока сервера нет, убить ещё и узел 7: его дети будут переподвешены
+cd "$(dirname "$0")"
+pkill -x client; pkill -x server; rm -f server.journal*
+( sleep 2; for c in "create 5" "create -3" "create 7" "create -5" "create 6" "exec 7 1 7"; do echo "$c"; sleep 1; done; sleep 1
+  kill -${SIG:-KILL} $(pgrep -x server) ) | ./server
+sleep 1
+[ -n "$KILL" ] && kill -9 $(pgrep -f "^client $KILL " | head -1)
+echo "======"
+( sleep 2; for c in "exec 7 1 7" "exec 6 2 6 6" "exec -5 1 -5" "status 0" "create 8" "exec 8 1 8" "remove 7" "exec 6 1 6" "exec * 1 1"; do echo "$c"; sleep 1.5; done
+  echo "exit" ) | ./server
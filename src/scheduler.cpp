@@ -0,0 +1,230 @@
+#include <iomanip>
+#include <algorithm>
+#include "scheduler.h"
+using namespace std;
+
+static double elapsed_ms(time_point from, time_point to) {
+	return chrono::duration<double, milli>(to - from).count();
+}
+
+scheduler::scheduler(int new_default_capacity, int new_max_queued) : default_capacity(new_default_capacity), max_queued(new_max_queued) {}
+
+int scheduler::capacity_of(int id) {
+	auto it = loads.find(id);
+	if (it == loads.end() || it->second.capacity == 0) {
+		return default_capacity;
+	}
+	return it->second.capacity;
+}
+
+void scheduler::start(int id, Message& msg, bool scheduled) {
+	time_point now = clock_now();
+	if (new_batch) {
+		new_batch = false;
+		batch_start = now;
+		batch_end = now;
+		for (auto& load : loads) {
+			load.second.done = 0;
+			load.second.slot_ms = 0;
+			load.second.changed = now;
+		}
+	}
+	node_load& load = loads[id];
+	account(load, now);
+	load.outstanding++;
+	msg.get_to_id() = id;
+	running[msg.uniq_num] = {id, scheduled, msg};
+}
+
+void scheduler::finish(node_load& load) {
+	time_point now = clock_now();
+	account(load, now);
+	load.outstanding--;
+	batch_end = now; // Серия длится, пока хоть одна задача занимает место на узле
+}
+
+void scheduler::account(node_load& load, time_point now) {
+	time_point from = max(load.changed, batch_start); // Узел мог появиться до начала серии
+	if (now > from) {
+		load.slot_ms += load.outstanding * elapsed_ms(from, now);
+	}
+	load.changed = now;
+}
+
+bool scheduler::pick(const node_index& nodes, int& best) {
+	bool found = false;
+	int best_load = 0;
+	for (int id : nodes.get_all_elems()) {
+		if (nodes.get(id)->pid == 0) { // CREATE ещё не подтверждён, и узел могут убрать из дерева
+			continue;
+		}
+		auto it = loads.find(id);
+		int load = it == loads.end() ? 0 : it->second.outstanding;
+		if (load < capacity_of(id) && (!found || load < best_load)) {
+			best = id;
+			best_load = load;
+			found = true;
+		}
+	}
+	return found;
+}
+
+DispatchResult scheduler::dispatch(const node_index& nodes, Message& msg) {
+	lock_guard<mutex> lock(mtx);
+	int best;
+	if (pick(nodes, best)) {
+		start(best, msg, true);
+		return DispatchResult::SENT;
+	}
+	if ((int)queue.size() >= max_queued) {
+		return DispatchResult::REJECTED;
+	}
+	queue.push_back(msg);
+	return DispatchResult::QUEUED;
+}
+
+bool scheduler::admit(int id, Message& msg) {
+	lock_guard<mutex> lock(mtx);
+	auto it = loads.find(id);
+	if (it != loads.end() && it->second.outstanding >= capacity_of(id)) {
+		return false;
+	}
+	start(id, msg, false);
+	return true;
+}
+
+void scheduler::update_credits(int id, int queue_depth, int credits) {
+	lock_guard<mutex> lock(mtx);
+	if (queue_depth + credits > 0) {
+		loads[id].capacity = queue_depth + credits;
+	}
+}
+
+bool scheduler::complete(int uniq_num, bool done, Message& next) {
+	lock_guard<mutex> lock(mtx);
+	auto it = running.find(uniq_num);
+	if (it == running.end()) {
+		return false;
+	}
+	int id = it->second.id;
+	running.erase(it);
+	node_load& load = loads[id];
+	load.done += done; // Отменённые и просроченные задачи работой не считаются
+	finish(load);
+	if (load.outstanding >= capacity_of(id) || !next_queued(next)) { // Просроченные задачи очереди выбрасываются, не доходя до узлов
+		return false;
+	}
+	start(id, next, true);
+	return true;
+}
+
+bool scheduler::next_queued(Message& next) {
+	while (!queue.empty()) {
+		next = queue.front();
+		queue.pop_front();
+		if (!next.expired()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool scheduler::pull(int id, Message& next) {
+	lock_guard<mutex> lock(mtx);
+	if (loads[id].outstanding >= capacity_of(id) || !next_queued(next)) {
+		return false;
+	}
+	start(id, next, true);
+	return true;
+}
+
+bool scheduler::pull_any(const node_index& nodes, Message& next) {
+	lock_guard<mutex> lock(mtx);
+	int id;
+	if (queue.empty() || !pick(nodes, id) || !next_queued(next)) {
+		return false;
+	}
+	start(id, next, true);
+	return true;
+}
+
+bool scheduler::retry(int uniq_num, int id) {
+	lock_guard<mutex> lock(mtx);
+	auto it = running.find(uniq_num);
+	if (it == running.end() || it->second.id != id) { // Задачу уже переназначили
+		return false;
+	}
+	finish(loads[id]);
+	bool scheduled = it->second.scheduled;
+	if (scheduled) {
+		queue.push_front(it->second.msg);
+	}
+	running.erase(it);
+	return scheduled;
+}
+
+bool scheduler::cancel(int uniq_num, int& id) {
+	lock_guard<mutex> lock(mtx);
+	for (auto it = queue.begin(); it != queue.end(); it++) {
+		if (it->uniq_num == uniq_num) {
+			queue.erase(it);
+			return true;
+		}
+	}
+	auto it = running.find(uniq_num);
+	id = it == running.end() ? -1 : it->second.id;
+	return false;
+}
+
+bool scheduler::abandon(int uniq_num) {
+	lock_guard<mutex> lock(mtx);
+	for (auto it = queue.begin(); it != queue.end(); it++) { // Задачу вернули в очередь, и там у неё вышел срок ответа
+		if (it->uniq_num == uniq_num) {
+			queue.erase(it);
+			return false;
+		}
+	}
+	auto it = running.find(uniq_num);
+	if (it == running.end()) {
+		return false;
+	}
+	finish(loads[it->second.id]);
+	running.erase(it);
+	return true;
+}
+
+int scheduler::forget(int id) {
+	lock_guard<mutex> lock(mtx);
+	int requeued = 0;
+	for (auto it = running.begin(); it != running.end();) {
+		if (it->second.id != id) {
+			it++;
+			continue;
+		}
+		if (it->second.scheduled) {
+			queue.push_front(it->second.msg);
+			requeued++;
+		}
+		it = running.erase(it);
+	}
+	loads.erase(id);
+	return requeued;
+}
+
+void scheduler::print_stats(ostream& out) {
+	lock_guard<mutex> lock(mtx);
+	time_point finish = running.empty() && queue.empty() ? batch_end : clock_now();
+	double makespan = new_batch ? 0 : elapsed_ms(batch_start, finish);
+	out << fixed << setprecision(1);
+	out << "Makespan: " << makespan << " ms, running: " << running.size() << ", queued: " << queue.size() << "\n";
+	for (auto& it : loads) { // Загрузка — доля мест очереди узла, занятых за серию
+		const node_load& load = it.second;
+		time_point from = max(load.changed, batch_start);
+		double slots = load.slot_ms + (finish > from ? load.outstanding * elapsed_ms(from, finish) : 0);
+		double total = capacity_of(it.first) * makespan;
+		out << "Node " << it.first << ": jobs " << load.done << ", utilization "
+			<< (total > 0 ? 100 * min(slots, total) / total : 0) << "%, capacity " << capacity_of(it.first) << "\n";
+	}
+	out.unsetf(ios::fixed);
+	new_batch = true;
+}
@@ -0,0 +1,70 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include "wrap_zmq.h"
+#include "node_index.h"
+#include "clock.h"
+using namespace std;
+
+enum struct DispatchResult {
+	SENT, // Задача назначена узлу
+	QUEUED, // Все узлы заняты, задача ждёт в очереди сервера
+	REJECTED, // Очередь сервера тоже заполнена
+};
+
+struct node_load { // Загрузка вычислительного узла
+	int outstanding = 0; // Задач отправлено и ещё не выполнено
+	int capacity = 0; // Сколько задач узел готов держать, по его последнему ответу; 0 — ещё не известно
+	int done = 0; // Выполнено задач за текущую серию
+	double slot_ms = 0; // Сумма по задачам текущей серии: сколько каждая занимала место на узле
+	time_point changed; // Когда последний раз менялось outstanding
+};
+
+struct running_job { // Задача, отправленная на узел
+	int id; // Узел, на котором она выполняется
+	bool scheduled; // Узел выбрал планировщик, и задачу можно отдать другому узлу
+	Message msg;
+};
+
+// Учёт задач exec на узлах. Задача без указания узла уходит на наименее
+// загруженный узел; если все узлы заняты, она ждёт в очереди, и её забирает
+// первый освободившийся узел. Сколько задач может держать узел, сервер узнаёт
+// из очереди узла, о которой тот сообщает в каждом ответе.
+class scheduler {
+public:
+	scheduler(int new_default_capacity, int new_max_queued);
+	DispatchResult dispatch(const node_index& nodes, Message& msg); // Назначает узел (to_id) или ставит задачу в очередь
+	bool admit(int id, Message& msg); // Задача на конкретный узел; false, если его очередь уже заполнена
+	void update_credits(int id, int queue_depth, int credits); // Загрузка, о которой сообщил узел
+	bool complete(int uniq_num, bool done, Message& next); // Узел ответил на задачу, done — выполнил её; true, если узел сразу забирает следующую задачу
+	bool pull(int id, Message& next); // Свободный узел забирает задачу из очереди
+	bool pull_any(const node_index& nodes, Message& next); // Задача из очереди уходит на любой свободный узел
+	bool retry(int uniq_num, int id); // Узел id не принял задачу; true, если она вернулась в начало очереди
+	bool abandon(int uniq_num); // Ответа на задачу не дождались: она убирается из очереди сервера или освобождает место на узле; true, если место освободилось
+	int forget(int id); // Узел умер: его задачи планировщика возвращаются в начало очереди; возвращает их число
+	bool cancel(int uniq_num, int& id); // true, если задача ждала в очереди сервера и убрана; иначе id — её узел или -1
+	void print_stats(ostream& out); // Загрузка узлов и время выполнения серии; следующая задача начнёт новую серию
+private:
+	int default_capacity; // Сколько задач давать узлу, пока он не сообщил о своей очереди
+	int max_queued; // Наибольшая длина очереди сервера
+	mutex mtx;
+	map<int, node_load> loads; // Загрузка по id узла
+	unordered_map<int, running_job> running; // uniq_num задачи -> задача
+	deque<Message> queue; // Задачи, ждущие свободного узла
+	bool new_batch = true; // Следующая задача начинает новую серию
+	time_point batch_start; // Начало текущей серии задач
+	time_point batch_end; // Окончание последней задачи серии
+	void start(int id, Message& msg, bool scheduled); // Отправка задачи на узел id
+	void finish(node_load& load); // Задача узла завершена, отклонена или потеряна
+	void account(node_load& load, time_point now); // Добавляет к slot_ms время с последнего изменения outstanding
+	int capacity_of(int id); // Сколько задач можно держать на узле
+	bool pick(const node_index& nodes, int& id); // Наименее загруженный запущенный узел со свободным местом
+	bool next_queued(Message& next); // Первая задача очереди, у которой не истёк срок
+};
+
+#endif
@@ -1,84 +1,240 @@
+#include <mutex>
+#include <future>
 #include <vector>
+#include <deque>
+#include <unordered_set>
+#include <cerrno>
+#include <poll.h>
 #include <unistd.h>
 #include <csignal>
 #include <iostream>
+#include <sstream>
+#include <climits>
+#include <cstdlib>
+#include <sys/syscall.h>
 #include "socket.h"
 #include "wrap_zmq.h"
-#include "tree.h"
+#include "server_core.h"
+#include "spsc_queue.h"
+#include "output.h"
+#include "placement.h"
+#include "clock.h"
 
 using namespace std;
 
-#define msg_wait_time 1
+#define JOURNAL_PATH "server.journal" // Журнал дерева, по нему перезапущенный сервер находит уже работающие узлы
+#define PROBE_WAIT 500 // Сколько после перезапуска ждать ответов узлов на проверку, мс
+#define ADOPT_WAIT 3000 // Сколько повторная проверка ждёт окончания переподвешиваний, мс
+#define SENDS_ENDPOINT "inproc://server_sends" // Очередь отправки к потоку ввода-вывода
+#define INBOX_SIZE 4096 // Сколько принятых сообщений может ждать разбора
+#define OUTPUT_SIZE 65536 // Сколько строк вывода может ждать консоли
+#define IO_WAIT_MS 100 // Как часто поток ввода-вывода проверяет переподвешивания к серверу
+#define DISPATCH_WAIT_MS 10 // Как часто поток разбора проверяет сроки запросов
+#define ROOT_WAIT_MS 100 // Сколько ждать ответа нового корня на одну проверку
+#define ROOT_WAIT_TRIES 50 // Сколько раз проверить новый корень, прежде чем принимать команды
+#define CLIENT_PATH "client" // Программа узла, относительно рабочего каталога сервера
+#define DELETED_SUFFIX " (deleted)" // Так /proc/<pid>/exe помечает файл, пересобранный после запуска процесса
 
-void* subscriber_thread(void* server);
+void* io_func(void* server);
+void* dispatch_func(void* server);
+
+thread_local bool io_owner = false; // Вызывающий поток — поток ввода-вывода, владелец сокетов
+thread_local void* own_sender = nullptr; // Сокет отправки вызывающего потока к потоку ввода-вывода
 void* heartbits_func(void* server);
 
-class Server {
+template <class F>
+future<request_result> as_future(F start) { // Запускает запрос с обработчиком и возвращает future его ответа
+	shared_ptr<promise<request_result>> done = make_shared<promise<request_result>>();
+	start([done](const request_result& result) { done->set_value(result); });
+	return done->get_future();
+}
+
+bool process_alive(pid_t pid) { // Жив ли процесс узла; завершившийся, но не убранный родителем, считается мёртвым
+#ifdef SYS_pidfd_open
+	int fd = syscall(SYS_pidfd_open, pid, 0);
+	if (fd != -1) {
+		pollfd pfd = {fd, POLLIN, 0};
+		bool exited = poll(&pfd, 1, 0) > 0; // pidfd становится читаемым, когда процесс завершился
+		close(fd);
+		return !exited;
+	}
+	if (errno == ESRCH) {
+		return false;
+	}
+#endif
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+bool is_client(pid_t pid) { // Запущен ли процесс pid из нашей программы узла; pid умершего узла мог достаться другому процессу
+	static string client_path = [] {
+		char path[PATH_MAX];
+		return realpath(CLIENT_PATH, path) ? string(path) : string();
+	}();
+	char exe[PATH_MAX];
+	ssize_t n = readlink(("/proc/" + to_string(pid) + "/exe").data(), exe, sizeof(exe));
+	if (n <= 0 || n == sizeof(exe) || client_path.empty()) {
+		return false;
+	}
+	string path(exe, n);
+	string deleted = DELETED_SUFFIX;
+	if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0) {
+		path.resize(path.size() - deleted.size());
+	}
+	return path == client_path;
+}
+
+bool client_alive(pid_t pid) { // Жив ли узел: процесс работает и это действительно узел
+	return process_alive(pid) && is_client(pid);
+}
+
+bool any_alive(const node_index& nodes) { // Остался ли хоть один процесс узла
+	for (int id : nodes.get_all_elems()) {
+		pid_t pid = nodes.get(id)->pid;
+		if (pid > 0 && client_alive(pid)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+class Server : public server_core {
 public:
 	pid_t pid; // pid сервера
-	tree t; // Дерево узлов
 	void *context = nullptr; // Контекст
 	Socket* publisher; // Сокет для передачи клиенту сообщения
 	Socket* subscriber; // Сокет для получения от клиента сообщения
-	bool working; // Переменная работоспособности сервера
-	pthread_t receive_thread; // Поток для получения сообщения
+	void* sends; // Сюда остальные потоки передают сообщения для publisher
+	mutex senders_mutex;
+	vector<void*> senders; // Сокеты отправки всех потоков, закрываются вместе с сервером
+	void* heartbit_sender = nullptr; // Общий для всех запусков heartbit: его потоки не работают одновременно
+	atomic<bool> working; // Переменная работоспособности сервера
+	atomic<bool> closing; // Деструктор уже запущен
+	bool remove_tree = false; // Команда exit: узлы и журнал больше не нужны; иначе следующий запуск подхватит дерево
+	pthread_t io_thread; // Поток ввода-вывода: единственный, кто трогает publisher и subscriber
+	pthread_t dispatch_thread; // Поток разбора ответов
+	spsc_queue<Message> inbox; // Ответы узлов от потока ввода-вывода к потоку разбора
+	output_writer out; // Вывод в консоль
 	pthread_t heartbits_thread;  // Поток для постоянной проверки узлов 
 	int heartbit_time; // Время которое надо ждать
-	bool is_heartbit; // Переменная для запуска или остановки heartbit
-	Server() { // Конструктор сервера
+	atomic<bool> is_heartbit; // Переменная для запуска или остановки heartbit
+	mutex adoptions_mutex;
+	vector<Message> local_adoptions; // Переподвешивания к самому серверу, выполняет поток ввода-вывода
+	atomic<bool> has_local_adoptions;
+	deque<pair<time_point, Message>> root_rejoins; // ADOPT подключённым корням и отправленные после них переподвешивания; только поток ввода-вывода
+	journal log; // Изменения дерева на диске
+	placement place; // Ядра, к которым привязаны узлы
+	bool recovered; // Дерево восстановлено из журнала, узлы работают с прошлого запуска
+	unordered_set<int> probed; // Узлы, ответившие на проверку после перезапуска
+	time_point probe_at; // Когда отправить проверку или подвести её итог
+	bool probing = false; // Проверка запланирована или идёт
+	bool probe_sent = false;
+	bool reprobed = false; // Проверка повторена после переподвешивания
+	atomic<bool> fresh_start; // Ни один узел прошлого запуска не ответил: новый корень запущен, поток ввода-вывода подключается к нему
+	Server(PinPolicy pin) : inbox(INBOX_SIZE), out(stdout, OUTPUT_SIZE), log(JOURNAL_PATH), place(pin) { // Конструктор сервера
 		context = create_zmq_ctx();
 		pid = getpid();
 		string endpoint = create_endpoint(EndpointType::CHILD_PUB_LEFT, getpid());
 		publisher = new Socket(context, SocketType::PUBLISHER, endpoint);
+		sends = create_zmq_socket(context, SocketType::PULL);
+		bind_zmq_socket(sends, SENDS_ENDPOINT);
+		node_index saved;
+		recovered = log.load(saved) && any_alive(saved);
+		if (recovered) { // Узлы прошлого запуска слушают адреса прошлого сервера, занимаем их
+			t.update([&saved](node_index& nodes) { nodes = saved; });
+			for (int id : saved.get_all_elems()) { // Узлы остаются на своих ядрах
+				place.adopt(id, saved.get(id)->pid);
+			}
+			for (auto& it : log.get_binds()) {
+				bind_zmq_socket(publisher->get_socket(), side_endpoint(it.first, it.second));
+			}
+		}
+		else {
+			log.clear();
+			log.bind(pid, true);
+			spawn_root(); // До первой команды: create в пустом дереве некуда отправить
+		}
+		if (recovered) {
+			schedule_probe(REJOIN_WAIT / 1000); // Узлы сначала переподключаются к занятым заново адресам
+		}
 		is_heartbit = false;
-		if (pthread_create(&receive_thread, 0, subscriber_thread, this) != 0) {
+		fresh_start = false;
+		has_local_adoptions = false;
+		closing = false;
+		working = true;
+		out.start();
+		if (pthread_create(&io_thread, 0, io_func, this) != 0) {
 			throw runtime_error("Can not run second thread.");
 		}
-		working = true;
+		if (pthread_create(&dispatch_thread, 0, dispatch_func, this) != 0) {
+			throw runtime_error("Can not run dispatch thread.");
+		}
+		if (!recovered) { // Пока новый корень не подписался, первая команда потерялась бы
+			for (int i = 0; i < ROOT_WAIT_TRIES && !check(0, ROOT_WAIT_MS); i++) {}
+		}
 	}
 	~Server() { // Деструктор сервера
-		if (!working) {
+		if (closing.exchange(true)) {
 			return;
 		}
-		working = false;
+		if (is_heartbit.exchange(false)) {
+			pthread_join(heartbits_thread, NULL);
+		}
 		try {
-			send(Message(CommandType::REMOVE_CHILD, 0, 0));
+			if (remove_tree) {
+				send(Message(CommandType::REMOVE_CHILD, UNIVERSAL_MSG, 0)); // Корень мог смениться после переподвешивания
+				log.clear();
+			}
+			working = false;
+			pthread_join(io_thread, NULL); // Поток ввода-вывода перед выходом отправляет всё, что ему передали
+			pthread_join(dispatch_thread, NULL);
+			out.stop();
+			for (void* sender : senders) {
+				zmq_close(sender);
+			}
+			zmq_close(sends);
 			delete publisher;
 			delete subscriber;
 			publisher = nullptr;
 			subscriber = nullptr;
 			destroy_zmq_ctx(context);
-			sleep(2);
+			sleep_ms(2000);
 		} 
 		catch (runtime_error &err) {
 			cout << "Server wasn't stopped " << err.what() << "\n";
 		}
 	}
-	void send(Message msg) { // Отправка сообщения
-		msg.to_up = false;
-		publisher->send(msg);
-	}
-	Message receive_msg() { // Получение сообщения от ребёнка
-		return subscriber->receive();
-	}
-	void create_child(int id) { // Создать дочерний узел
-		if (t.find(id)) {
-			throw runtime_error("Error:" + to_string(id) + ":Node with that number already exists.");
+	void post(Message& msg) override { // Сокетом владеет поток ввода-вывода, остальные передают сообщение ему
+		if (io_owner) {
+			publisher->send(msg);
 		}
-		if (t.get_place(id) && !check(t.get_place(id))) {
-			throw runtime_error("Error:" + to_string(id) + ":Parent node is unavailable.");
+		else {
+			send_zmq_msg(sender(), msg);
 		}
-		send(Message(CommandType::CREATE_CHILD, t.get_place(id), id));
-		t.insert(id);
-	}	
-	void remove_child(int id) { // Удаление дочернего узла
-		if (!t.find(id)) {
-			throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+	}
+	void* sender() { // Свой сокет отправки у каждого потока: сокеты ZMQ нельзя делить между потоками
+		if (own_sender == nullptr) {
+			own_sender = new_sender();
 		}
-		if (!check(id)) {
-			throw runtime_error("Error:" + to_string(id) + ":Node is unavailable.");
+		return own_sender;
+	}
+	void* new_sender() {
+		void* socket = create_zmq_socket(context, SocketType::PUSH);
+		connect_zmq_socket(socket, SENDS_ENDPOINT);
+		lock_guard<mutex> lock(senders_mutex);
+		senders.push_back(socket);
+		return socket;
+	}
+	void* get_heartbit_sender() { // Вызывает поток heartbit; прошлый поток к этому времени уже завершён
+		if (heartbit_sender == nullptr) {
+			heartbit_sender = new_sender();
+		}
+		return heartbit_sender;
+	}
+	void forward_sends() { // Поток ввода-вывода отправляет узлам всё, что передали другие потоки
+		Message msg;
+		while (get_zmq_msg(sends, msg, ZMQ_DONTWAIT)) {
+			publisher->send(msg);
 		}
-		send(Message(CommandType::REMOVE_CHILD, id, 0));
 	}
 	void start_heartbit() { // Начать проверку работоспособности всех узлов 
 		if (!is_heartbit) {
@@ -97,37 +253,150 @@ public:
 			}
 		}
 	}
-	void exec_child(int id) { // Выполнение команды на дочернем узле с индексом id
-		int n;
-		cin >> n;
-		vector<int> v(n);
-		for (int i = 0; i < n; i++) {
-			cin >> v[i];
+	future<request_result> check_future(int id, int timeout_ms) { // Проверка доступности узла, ответ — через future
+		return as_future([&](reply_handler handler) { check_async(id, timeout_ms, move(handler)); });
+	}
+	pid_t get_pid() { // Возвращает pid
+		return pid;
+	}
+	bool check(int id, int timeout_ms = REQUEST_TIMEOUT) { // Проверяет доступность узла, ожидая ответа не дольше timeout_ms
+		return check_future(id, timeout_ms).get().error == ErrorType::NONE;
+	}
+	bool node_alive(pid_t pid) override {
+		return client_alive(pid);
+	}
+	void print(const string& line) override {
+		out.print(line);
+	}
+	void journal_change(const node_index& nodes, JournalType type, int id, pid_t pid, int side) override {
+		log.append(nodes, type, id, pid, side);
+	}
+	int assign_cpu(int id, int parent) override {
+		return place.assign(id, parent);
+	}
+	void probe_answered(int id) override {
+		probed.insert(id);
+	}
+	void rehome_root(vector<Message>& adoptions) override { // Новый корень подключает поток ввода-вывода, остальные идут уже через него
+		lock_guard<mutex> lock(adoptions_mutex);
+		local_adoptions.insert(local_adoptions.end(), adoptions.begin(), adoptions.end());
+		has_local_adoptions = true;
+	}
+	void release_cpus() override {
+		shared_ptr<const node_index> nodes = t.snapshot();
+		place.retain([&nodes](int id) { return nodes->find(id); });
+	}
+	void adopt_root(Message& msg) { // Подключает переподвешенный корень к сокетам сервера; ответит уже сам корень
+		bind_zmq_socket(publisher->get_socket(), side_endpoint(msg.buf[0], msg.buf[1]));
+		log.bind(msg.buf[0], msg.buf[1]);
+		connect_zmq_socket(subscriber->get_socket(), create_endpoint(EndpointType::PARENT_PUB, msg.pid));
+		msg.get_to_id() = msg.get_create_id();
+		root_rejoins.emplace_back(clock_now() + chrono::microseconds(REJOIN_WAIT), msg); // ADOPT уйдёт, когда корень переподключится
+	}
+	void adopt_after_root(Message& msg) { // Переподвешивание под новый корень идёт через него, поэтому после его ADOPT
+		if (root_rejoins.empty()) {
+			send(msg);
 		}
-		if (!t.find(id)) {
-			throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+		else {
+			root_rejoins.emplace_back(root_rejoins.back().first, msg);
 		}
-		if (!check(id)) {
-			throw runtime_error("Error:" + to_string(id) + ":Node is unavailable.");
+	}
+	void send_rejoins() { // Отправляет по порядку всё, чьё время на переподключение корня истекло
+		bool sent = false;
+		while (!root_rejoins.empty() && clock_now() >= root_rejoins.front().first) {
+			send(root_rejoins.front().second);
+			root_rejoins.pop_front();
+			sent = true;
+		}
+		if (sent && root_rejoins.empty()) {
+			pull_jobs();
 		}
-		send(Message(CommandType::EXEC_CHILD, id, n, v.data(), 0));
 	}
-	pid_t get_pid() { // Возвращает pid
-		return pid;
+	int rejoin_wait_ms(int limit_ms) { // Сколько потоку ввода-вывода можно ждать до следующего ADOPT
+		if (root_rejoins.empty()) {
+			return limit_ms;
+		}
+		int left = chrono::duration_cast<chrono::milliseconds>(root_rejoins.front().first - clock_now()).count();
+		return min(limit_ms, max(0, left));
+	}
+	void schedule_probe(int delay_ms) { // Широковещательная проверка всех узлов после перезапуска
+		probing = true;
+		probe_sent = false;
+		probe_at = clock_now() + chrono::milliseconds(delay_ms);
+	}
+	void poll_probe() { // Вызывает поток разбора: отправка проверки и итог после PROBE_WAIT
+		if (!probing || clock_now() < probe_at) {
+			return;
+		}
+		if (!probe_sent) {
+			if (adopting > 0 && clock_now() < probe_at + chrono::milliseconds(ADOPT_WAIT)) {
+				return;
+			}
+			probed.clear();
+			probe_sent = true;
+			probe_at = clock_now() + chrono::milliseconds(PROBE_WAIT);
+			send(Message(CommandType::PROBE, UNIVERSAL_MSG, 0));
+			return;
+		}
+		probing = false;
+		shared_ptr<const node_index> nodes = t.snapshot();
+		vector<int> silent;
+		for (int id : nodes->get_all_elems()) {
+			if (!probed.count(id)) {
+				silent.push_back(id);
+			}
+		}
+		if (!silent.empty() && !reprobed) { // Узлы за умершими ответят только после переподвешивания
+			for (int id : silent) {
+				rehome_if_dead(id);
+			}
+			if (t.snapshot()->size() != nodes->size()) {
+				reprobed = true;
+				schedule_probe(REJOIN_WAIT / 1000);
+				return;
+			}
+		}
+		if (silent.size() == (size_t)nodes->size()) { // Восстанавливать некого: начинаем с нового корня, как при обычном запуске
+			out.print("No node answered the probe, starting a new tree\n");
+			t.update([](node_index& nodes) { nodes = node_index(); });
+			release_cpus();
+			log.clear();
+			log.bind(pid, true);
+			spawn_root();
+			fresh_start = true;
+			return;
+		}
+		out.print("Recovered " + to_string(nodes->size()) + " nodes from journal, answered: " + to_string(nodes->size() - silent.size()) + "\n");
+		for (int id : silent) {
+			out.print("Node " + to_string(id) + " didn't answer the probe\n");
+		}
 	}
-	bool check(int id) { // Проверяет доступность узла
-		Message msg(CommandType::RETURN, id, 0);
-		send(msg);
-		sleep(msg_wait_time);
-		msg.get_to_id() = SERVER_ID;
-		return last_msg == msg;
+	pid_t spawn_root() { // Запускает корень и заносит его в пустое дерево
+		int cpu = place.assign(0, -1);
+		int numa = place.numa_node(cpu);
+		pid_t child_pid = fork();
+		if (child_pid == -1) {
+			throw runtime_error("Can not fork");
+		}
+		if (child_pid == 0) {
+			pin_self(cpu, numa);
+			execl(CLIENT_PATH, "client", "0", publisher->get_endpoint().data(), "-1", nullptr);
+			throw runtime_error("Can not execl");
+		}
+		t.update([this, child_pid](node_index& nodes) {
+			nodes.insert(0);
+			nodes.get(0)->pid = child_pid;
+			nodes.get(0)->listen_pid = pid;
+			nodes.get(0)->listen_left = true;
+			log.append(nodes, JournalType::INSERT, 0);
+			log.append(nodes, JournalType::SET_PID, 0, child_pid);
+			log.append(nodes, JournalType::LISTEN, 0, pid, true);
+		});
+		return child_pid;
 	}
-	bool check(int id, int time) { // Проверяет доступность узла, ожидание в ms
-		Message msg(CommandType::RETURN, id, 0);
-		send(msg);
-		usleep(4 * time);
-		msg.get_to_id() = SERVER_ID;
-		return last_msg == msg;
+	pid_t root_pid() {
+		shared_ptr<const node_index> nodes = t.snapshot();
+		return nodes->get(nodes->get_root())->pid;
 	}
 	Socket*& get_publisher() {
 		return publisher;
@@ -138,79 +407,127 @@ public:
 	void* get_context() {
 		return context;
 	}
-	tree& get_tree() {
+	topology& get_tree() {
 		return t;
 	}
-	Message last_msg; // Сохраняет последнее сообщение
 };
 
 void* heartbits_func(void* server) { // Проверяет работоспособность всех узлов, пока команда не будет введена повторно
 	Server* server_ptr = (Server*) server;
+	own_sender = server_ptr->get_heartbit_sender(); // Повторный запуск heartbit не создаёт новый сокет
 	while (server_ptr->is_heartbit) {
-		usleep(server_ptr->heartbit_time/4);
-		vector<int> tmp = server_ptr->get_tree().get_all_elems();
+		sleep_us(server_ptr->heartbit_time/4);
+		shared_ptr<const node_index> nodes = server_ptr->get_tree().snapshot(); // Снимок не меняется во время обхода
+		int timeout_ms = max(1, 4 * server_ptr->heartbit_time / 1000);
+		vector<pair<int, future<request_result>>> answers; // Все узлы проверяются одновременно, раунд длится одно ожидание
+		for (int i : nodes->get_all_elems()) {
+			answers.emplace_back(i, server_ptr->check_future(i, timeout_ms));
+		}
 		bool not_answer = false;
-		for (int& i : tmp) {
-			if (!(server_ptr->check(i, server_ptr->heartbit_time))) {
+		for (auto& answer : answers) {
+			int i = answer.first;
+			if (answer.second.get().error != ErrorType::NONE) {
 				not_answer = true;
-				cout << "Heartbit: node " << i <<  " is unavailable now\n";
+				if (!server_ptr->rehome_if_dead(i)) {
+					server_ptr->out.print("Heartbit: node " + to_string(i) + " is unavailable now\n");
+				}
 			}
 		}
 		if (!not_answer) {
-			cout << "OK\n";
+			server_ptr->out.print("OK\n");
 		}
 	}
+	return nullptr;
 }
 
-void* subscriber_thread(void* server) { // Поток для получения сообщения
+void* io_func(void* server) { // Поток ввода-вывода: принимает ответы узлов и отправляет им сообщения всех потоков
 	Server* server_ptr = (Server*) server;
-	pid_t serv_pid = server_ptr->get_pid();
+	io_owner = true;
 	try {
-		pid_t child_pid = fork();
-		if (child_pid == -1) {
-			throw runtime_error("Can not fork");
-		}
-		if (child_pid == 0) {
-			execl("client", "client", "0", server_ptr->get_publisher()->get_endpoint().data(), "-1", nullptr);
-			throw runtime_error("Can not execl");
-			server_ptr->~Server();
-			return (void*)-1;
-		}
-		string endpoint = create_endpoint(EndpointType::PARENT_PUB, child_pid);
+		string endpoint = create_endpoint(EndpointType::PARENT_PUB, server_ptr->root_pid()); // Корень уже запущен конструктором или работает с прошлого запуска
 		server_ptr->get_subscriber() = new Socket(server_ptr->get_context(), SocketType::SUBSCRIBER, endpoint);
-		server_ptr->get_tree().insert(0);
-		for (;;) {
-			Message msg = server_ptr->get_subscriber()->receive();
-			if (msg.command == CommandType::ERROR){
-				throw invalid_argument("Wrong command");
+		void* subscriber = server_ptr->get_subscriber()->get_socket();
+		while (server_ptr->working) {
+			if (server_ptr->fresh_start.exchange(false)) {
+				connect_zmq_socket(subscriber, create_endpoint(EndpointType::PARENT_PUB, server_ptr->root_pid()));
+			}
+			if (server_ptr->has_local_adoptions.exchange(false)) {
+				lock_guard<mutex> lock(server_ptr->adoptions_mutex);
+				for (Message& adoption : server_ptr->local_adoptions) {
+					if (adoption.get_to_id() == SERVER_ID) {
+						server_ptr->adopt_root(adoption);
+					}
+					else {
+						server_ptr->adopt_after_root(adoption);
+					}
+				}
+				server_ptr->local_adoptions.clear();
+				if (server_ptr->root_rejoins.empty()) { // Иначе задачи уйдут после ADOPT корню
+					server_ptr->pull_jobs();
+				}
 			}
-			server_ptr->last_msg = msg;
-			if (msg.command == CommandType::CREATE_CHILD){
-				cout << "OK:" << msg.get_create_id() << "\n";
+			server_ptr->send_rejoins();
+			bool rejoining = !server_ptr->root_rejoins.empty(); // Пока корень переподключается, отправка ждёт в очереди, а приём идёт
+			Message* cell = server_ptr->inbox.slot();
+			zmq_pollitem_t items[2] = {{subscriber, 0, ZMQ_POLLIN, 0}, {server_ptr->sends, 0, ZMQ_POLLIN, 0}};
+			int count = (cell ? 1 : 0) + (rejoining ? 0 : 1); // Поток разбора не успевает: ответы подождут в буфере ZMQ
+			if (zmq_poll(cell ? items : items + 1, count, server_ptr->rejoin_wait_ms(cell ? IO_WAIT_MS : 1)) == -1) {
+				throw runtime_error("Can not poll sockets.");
 			}
-			else if (msg.command == CommandType::REMOVE_CHILD) {
-				cout << "OK" << "\n";
-				server_ptr->get_tree().delete_el(msg.get_create_id());
+			if (items[1].revents & ZMQ_POLLIN) {
+				server_ptr->forward_sends();
 			}
-			else if (msg.command == CommandType::EXEC_CHILD) {
-				cout << "OK:" << msg.get_create_id() << ":" << msg.sum << "\n";
+			while (cell && get_zmq_msg(subscriber, *cell, ZMQ_DONTWAIT)) { // Принимаем сразу в ячейку очереди
+				server_ptr->inbox.commit();
+				cell = server_ptr->inbox.slot();
 			}
 		}
+		server_ptr->forward_sends(); // В том числе последнее REMOVE_CHILD из деструктора
 	} 
 	catch (runtime_error& err) {
-		cout << "Server wasn't started " << err.what() << "\n";
+		server_ptr->out.print("Server wasn't started " + string(err.what()) + "\n");
 	} 
 	catch (invalid_argument& err) {
-		cout << err.what() << "\n";
+		server_ptr->out.print(string(err.what()) + "\n");
+	}
+	return nullptr;
+}
+
+void* dispatch_func(void* server) { // Поток разбора: сопоставляет ответы с запросами и меняет дерево
+	Server* server_ptr = (Server*) server;
+	server_ptr->out.set_fast_producer();
+	while (server_ptr->working) {
+		server_ptr->pending.expire();
+		server_ptr->poll_probe();
+		Message* msg = server_ptr->inbox.wait_front(DISPATCH_WAIT_MS);
+		if (msg == nullptr) {
+			continue;
+		}
+		server_ptr->dispatch(*msg);
+		server_ptr->inbox.pop();
 	}
 	return nullptr;
 }
 
-void process_cmd(Server& server, string cmd){ // Исполнение пользовательской команды
+vector<int> read_values() { // Читает "n v1 ... vn" аргумента exec
+	int n;
+	cin >> n;
+	if (n < 0 || n > MAX_SIZE) {
+		throw runtime_error("Error: Wrong number of elements.");
+	}
+	vector<int> v(n);
+	for (int i = 0; i < n; i++) {
+		cin >> v[i];
+	}
+	return v;
+}
+
+void process_cmd(Server& server, string cmd){ // Исполнение пользовательской команды; ответы узлов печатаются по мере прихода
+	reply_handler print_result = [&server](const request_result& result) { server.out.print(describe(result)); };
 	if (cmd == "create") { // Создание узла
 		int id;
 		cin >> id;
-		server.create_child(id);
+		server.create_async(id, print_result);
 	} 
 	else if (cmd == "remove") { // Удаление узла
 		int id;
@@ -218,14 +535,70 @@ void process_cmd(Server& server, string cmd){ // Исполнение польз
 		if (id == 0) {
 			throw runtime_error("Can't remove root");
 		}
-		server.remove_child(id);
+		server.remove_async(id, print_result);
 	} 
 	else if (cmd == "exec") { // Выполнение задачи на узле
-		int id;
-		cin >> id;
-		server.exec_child(id);
+		string target;
+		cin >> target;
+		if (target == "*") { // Узел выбирает планировщик
+			vector<int> v = read_values();
+			server.exec_any_async(v.data(), v.size(), print_result);
+		}
+		else {
+			int id;
+			try {
+				id = stoi(target);
+			}
+			catch (logic_error&) { // invalid_argument здесь означал бы выход из программы
+				throw runtime_error("Error: Wrong node id.");
+			}
+			vector<int> v = read_values();
+			server.exec_async(id, v.data(), v.size(), print_result);
+		}
+	} 
+	else if (cmd == "codec") { // Сжатие данных exec: raw, delta или for
+		string name;
+		cin >> name;
+		if (!parse_codec(name, server.payload_codec)) {
+			throw runtime_error("Error: Unknown codec, expected raw, delta or for.");
+		}
+		server.out.print("OK\n");
+	} 
+	else if (cmd == "deadline") { // Срок задач exec в мс, 0 — без срока
+		int ms;
+		cin >> ms;
+		if (ms < 0) {
+			throw runtime_error("Error: Wrong deadline.");
+		}
+		server.deadline_ms = ms;
+		server.out.print("OK\n");
 	} 
-	else if (cmd == "exit") { // Выход из программы
+	else if (cmd == "cancel") { // Отмена задачи exec по номеру запроса
+		int req;
+		cin >> req;
+		server.cancel_async(req, print_result);
+	} 
+	else if (cmd == "aggregate") { // aggregate status — сводка здоровья дерева
+		string what;
+		cin >> what;
+		if (what != "status") {
+			throw runtime_error("Error: Usage: aggregate status");
+		}
+		server.aggregate_async(print_result);
+	} 
+	else if (cmd == "pending") { // Запросы, ждущие ответа
+		ostringstream list;
+		server.pending.print(list);
+		server.out.print(list.str());
+	} 
+	else if (cmd == "stats") { // Загрузка узлов задачами планировщика
+		ostringstream stats;
+		server.jobs.print_stats(stats);
+		server.place.print_stats(stats);
+		server.out.print(stats.str());
+	} 
+	else if (cmd == "exit") { // Выход из программы вместе с узлами
+		server.remove_tree = true;
 		throw invalid_argument("Exiting...");
 	} 
 	else if (cmd == "heartbit") { // Проверка на работоспособность узлов
@@ -234,32 +607,33 @@ void process_cmd(Server& server, string cmd){ // Исполнение польз
 	else if (cmd == "status") { // Проверка узла
 		int id;
 		cin >> id;
-		if (!server.get_tree().find(id)) {
+		if (!server.get_tree().snapshot()->find(id)) {
 			throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
 		}
 		if (server.check(id)) {
-			cout << "OK" << "\n";
+			server.out.print("OK\n");
 		} 
 		else {
-			cout << "Node is unavailable" << "\n";
+			server.rehome_if_dead(id);
+			server.out.print("Node is unavailable\n");
 		}
 	}
 	else {
-		cout << "It is not a command!\n";
+		server.out.print("It is not a command!\n");
 	}
 }
 
-Server* server_ptr = nullptr;
-void TerminateByUser(int) { 
-	if (server_ptr != nullptr) {
-		server_ptr->~Server();
+string terminate_note; // Готовится заранее: в обработчике сигнала нельзя выделять память и писать в cout
+void TerminateByUser(int sig) { // Узлы и журнал остаются: перезапущенный сервер подхватит дерево, удаляет его только exit
+	if (write(STDOUT_FILENO, terminate_note.data(), terminate_note.size()) == -1) {
+		_exit(EXIT_FAILURE);
 	}
-	cout << to_string(getpid()) + " Terminated by user" << "\n";
-	exit(0);
+	_exit(sig == SIGSEGV ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
 int main (int argc, char const *argv[]) {
 	try{
+		terminate_note = to_string(getpid()) + " Terminated by user, nodes keep running\n";
 		if (signal(SIGINT, TerminateByUser) == SIG_ERR) { // Обработка сигналов
 			throw runtime_error("Can not set SIGINT signal");
 		}
@@ -269,9 +643,14 @@ int main (int argc, char const *argv[]) {
 		if (signal(SIGTERM, TerminateByUser) == SIG_ERR) { // Обработка сигналов
 			throw runtime_error("Can not set SIGTERM signal");
 		}
-		Server server;
-		server_ptr = &server;
-		cout << getpid() << " server started correctly!\n";
+		PinPolicy pin = PinPolicy::NONE; // ./server --pin none|shared|exclusive
+		for (int i = 1; i < argc; i++) {
+			if (string(argv[i]) != "--pin" || i + 1 == argc || !parse_pin_policy(argv[++i], pin)) {
+				throw runtime_error("Usage: ./server [--pin none|shared|exclusive]");
+			}
+		}
+		Server server(pin);
+		server.out.print(to_string(getpid()) + " server started correctly!\n");
 		for (;;) {
 			try {
 				string cmd;
@@ -280,7 +659,7 @@ int main (int argc, char const *argv[]) {
 				}
 			} 
 			catch (const runtime_error& arg) {
-				cout << arg.what() << "\n";
+				server.out.print(string(arg.what()) + "\n");
 			}
 		}
 	} 
@@ -288,6 +667,6 @@ int main (int argc, char const *argv[]) {
 		cout << arg.what() << endl;
 	} 
 	catch(...) {}
-	sleep(7);
+	sleep_ms(7000);
 	return 0;
 }
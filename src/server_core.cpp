@@ -0,0 +1,324 @@
+#include <sstream>
+#include <stdexcept>
+#include "server_core.h"
+using namespace std;
+
+server_core::server_core() : jobs(QUEUE_SIZE, MAX_QUEUED), adopting(0) {}
+
+void server_core::send(Message& msg) {
+	msg.to_up = false;
+	msg.route = ROUTE_ALL; // Корень один, его подписка принимает ROUTE_ALL
+	post(msg);
+}
+
+void server_core::send(Message&& msg) {
+	send(msg);
+}
+
+void server_core::request(Message& msg, reply_handler handler, int timeout_ms) {
+	pending.add(msg, move(handler), timeout_ms); // До отправки, чтобы ответ не обогнал регистрацию
+	send(msg);
+}
+
+void server_core::create_async(int id, reply_handler handler) {
+	shared_ptr<const node_index> nodes = t.snapshot();
+	if (nodes->find(id)) {
+		throw runtime_error("Error:" + to_string(id) + ":Node with that number already exists.");
+	}
+	if (nodes->get_root() == NO_NODE) { // get_place вернул бы -1, и запрос ушёл бы всем узлам
+		throw runtime_error("Error:" + to_string(id) + ":Tree has no root yet.");
+	}
+	int parent = nodes->get_place(id);
+	t.update([this, id](node_index& nodes) { // До отправки, чтобы ответ нашёл узел в дереве
+		nodes.insert(id);
+		journal_change(nodes, JournalType::INSERT, id);
+	});
+	Message msg(CommandType::CREATE_CHILD, parent, id);
+	msg.cpu = assign_cpu(id, parent);
+	msg.set_deadline(REQUEST_TIMEOUT); // Опоздавший узел не создаст ребёнка, которого сервер уже убрал из дерева
+	request(msg, [this, id, parent, handler](const request_result& result) {
+		if (result.error == ErrorType::TIMEOUT) { // Процесс мог запуститься, а потеряться только ответ
+			check_created(id, parent, result, handler);
+			return;
+		}
+		if (result.error != ErrorType::NONE) {
+			drop_created(id, parent);
+		}
+		handler(result);
+	}, REQUEST_TIMEOUT);
+}
+
+void server_core::check_created(int id, int parent, const request_result& timeout, reply_handler handler) {
+	check_async(id, REQUEST_TIMEOUT, [this, id, parent, timeout, handler](const request_result& result) {
+		if (result.error != ErrorType::NONE) {
+			send(Message(CommandType::REMOVE_CHILD, id, 0)); // Если процесс всё же запущен, он завершится, а не останется сиротой
+			drop_created(id, parent);
+			handler(timeout);
+			return;
+		}
+		confirm_created(id, result.pid); // Узел отвечает: он создан, ответ на CREATE потерялся
+		request_result created = result;
+		created.command = CommandType::CREATE_CHILD;
+		handler(created);
+	});
+}
+
+void server_core::drop_created(int id, int parent) {
+	t.update([this, id](node_index& nodes) {
+		nodes.delete_el(id);
+		journal_change(nodes, JournalType::DELETE, id);
+	});
+	release_cpus();
+	rehome_if_dead(parent);
+}
+
+bool server_core::confirm_created(int id, pid_t pid) {
+	bool found = false;
+	t.update([this, id, pid, &found](node_index& nodes) {
+		if (!nodes.find(id)) {
+			return;
+		}
+		found = true;
+		node_info* node = nodes.get(id);
+		node->pid = pid;
+		journal_change(nodes, JournalType::SET_PID, id, pid);
+		if (!nodes.is_root(id)) { // Узел слушает адрес создавшего его родителя со своей стороны
+			int parent = nodes.get_parent_id(id);
+			node->listen_pid = nodes.get(parent)->pid;
+			node->listen_left = id < parent;
+			journal_change(nodes, JournalType::LISTEN, id, node->listen_pid, node->listen_left);
+		}
+	});
+	Message next;
+	if (found && jobs.pull(id, next)) { // Новый узел сразу забирает задачу из очереди
+		send_job(next);
+	}
+	return found;
+}
+
+void server_core::remove_async(int id, reply_handler handler) {
+	if (!t.snapshot()->find(id)) {
+		throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+	}
+	Message msg(CommandType::REMOVE_CHILD, id, 0);
+	msg.set_deadline(REQUEST_TIMEOUT);
+	request(msg, on_error_rehome(id, move(handler)), REQUEST_TIMEOUT);
+}
+
+void server_core::exec_async(int id, const int* data, int n, reply_handler handler) {
+	if (n < 0 || n > MAX_SIZE) {
+		throw runtime_error("Error: Wrong number of elements.");
+	}
+	if (!t.snapshot()->find(id)) {
+		throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+	}
+	Message msg(CommandType::EXEC_CHILD, id, n, data, 0);
+	msg.encode(payload_codec);
+	msg.set_deadline(deadline_ms);
+	if (!jobs.admit(id, msg)) {
+		throw runtime_error("Error:" + to_string(id) + ":Node queue is full.");
+	}
+	request(msg, on_error_rehome(id, move(handler)), deadline_ms > 0 ? deadline_ms : REQUEST_TIMEOUT);
+}
+
+void server_core::exec_any_async(const int* data, int n, reply_handler handler) {
+	if (n < 0 || n > MAX_SIZE) {
+		throw runtime_error("Error: Wrong number of elements.");
+	}
+	Message msg(CommandType::EXEC_CHILD, 0, n, data, 0);
+	msg.encode(payload_codec);
+	msg.set_deadline(deadline_ms);
+	reply_handler done = [this, handler](const request_result& result) {
+		if (result.error == ErrorType::TIMEOUT && jobs.abandon(result.request)) { // Задача потерялась по дороге: её место на узле свободно
+			pull_jobs();
+		}
+		handler(result);
+	};
+	switch (jobs.dispatch(*t.snapshot(), msg)) {
+		case DispatchResult::SENT: // Задачу могут переназначать, поэтому ждём её только до срока самой задачи
+			request(msg, move(done), deadline_ms > 0 ? deadline_ms : REQUEST_TIMEOUT);
+			break;
+		case DispatchResult::QUEUED: // Без срока задача ждёт очереди сколько угодно, срок ответа отсчитывается с отправки
+			pending.add(msg, move(done), deadline_ms);
+			break;
+		case DispatchResult::REJECTED:
+			throw runtime_error("Error: All nodes are busy, job rejected.");
+	}
+}
+
+void server_core::cancel_async(int req, reply_handler handler) {
+	int id;
+	if (jobs.cancel(req, id)) { // Задача ещё ждала в очереди сервера
+		pending.cancel(req);
+		request_result result;
+		result.command = CommandType::CANCEL;
+		result.id = SERVER_ID;
+		result.sum = 1;
+		result.request = req;
+		handler(result);
+		return;
+	}
+	if (id == -1) {
+		throw runtime_error("Error: Request " + to_string(req) + " is not a running exec.");
+	}
+	int data[1] = {req};
+	Message msg(CommandType::CANCEL, id, 1, data, 0); // Идёт по тому же пути, что и задача, поэтому не обгонит её
+	msg.set_deadline(REQUEST_TIMEOUT);
+	request(msg, move(handler), REQUEST_TIMEOUT);
+}
+
+void server_core::aggregate_async(reply_handler handler) {
+	Message msg(CommandType::AGGREGATE, UNIVERSAL_MSG, 0);
+	msg.set_deadline(AGGREGATE_WAIT); // Узлы с не ответившими детьми отправят неполную сводку к сроку
+	request(msg, move(handler), AGGREGATE_WAIT + REQUEST_TIMEOUT);
+}
+
+void server_core::check_async(int id, int timeout_ms, reply_handler handler) {
+	Message msg(CommandType::RETURN, id, 0);
+	msg.set_deadline(timeout_ms);
+	request(msg, move(handler), timeout_ms);
+}
+
+reply_handler server_core::on_error_rehome(int id, reply_handler handler) {
+	return [this, id, handler](const request_result& result) {
+		bool freed = result.error == ErrorType::TIMEOUT && jobs.abandon(result.request); // Ответа уже не будет: место задачи на узле свободно
+		if (result.error == ErrorType::TIMEOUT || result.error == ErrorType::NO_ROUTE) {
+			rehome_if_dead(id);
+		}
+		if (freed) {
+			pull_jobs();
+		}
+		handler(result);
+	};
+}
+
+void server_core::pull_jobs() {
+	Message next;
+	while (jobs.pull_any(*t.snapshot(), next)) {
+		send_job(next);
+	}
+}
+
+void server_core::send_job(Message& job) {
+	pending.arm(job.uniq_num, REQUEST_TIMEOUT); // Задача без срока ждала в очереди; с этого момента ждём ответа узла
+	send(job);
+}
+
+bool server_core::rehome_if_dead(int id) {
+	shared_ptr<const node_index> nodes = t.snapshot();
+	bool dead = false;
+	for (int cur = id; nodes->find(cur); cur = nodes->get_parent_id(cur)) {
+		const node_info* node = nodes->get(cur);
+		if (node->pid > 0 && !node_alive(node->pid)) {
+			rehome(cur, node->pid);
+			dead = dead || cur == id;
+		}
+		if (nodes->is_root(cur)) {
+			break;
+		}
+	}
+	return dead;
+}
+
+void server_core::rehome(int id, pid_t dead_pid) {
+	vector<Message> adoptions;
+	bool removed = false;
+	t.update([&](node_index& nodes) {
+		const node_info* dead = nodes.get(id);
+		if (dead == nullptr || dead->pid != dead_pid) { // Уже переподвешен другим потоком
+			return;
+		}
+		vector<int> moved = nodes.remove_node(id);
+		journal_change(nodes, JournalType::REMOVE_NODE, id);
+		for (int child : moved) {
+			const node_info* orphan = nodes.get(child);
+			int data[2] = {orphan->listen_pid, orphan->listen_left}; // Адрес, который слушает ребёнок: его займёт новый родитель
+			int parent = nodes.is_root(child) ? SERVER_ID : nodes.get_parent_id(child);
+			adoptions.emplace_back(CommandType::ADOPT_CHILD, parent, 2, data, child);
+			adoptions.back().pid = orphan->pid;
+		}
+		removed = true;
+	});
+	if (!removed) {
+		return;
+	}
+	release_cpus();
+	adopting += adoptions.size();
+	ostringstream line;
+	line << "Node " << id << " is dead." << (adoptions.empty() ? "" : " Rehoming:");
+	for (Message& msg : adoptions) {
+		line << " " << msg.get_create_id();
+	}
+	int requeued = jobs.forget(id); // Задачи умершего узла заберут живые узлы
+	if (requeued) {
+		line << " Requeued jobs: " << requeued;
+	}
+	line << "\n";
+	print(line.str());
+	if (!adoptions.empty() && adoptions[0].get_to_id() == SERVER_ID) {
+		rehome_root(adoptions);
+		return;
+	}
+	for (Message& msg : adoptions) {
+		send(msg);
+	}
+	pull_jobs(); // Умерший лист никого не переподвешивает, поэтому раздаём его задачи сразу
+}
+
+void server_core::dispatch(Message& msg) {
+	Message next; // Следующая задача планировщика
+	if (msg.command == CommandType::ERROR) { // Сообщение не дошло до адресата
+		if (jobs.retry(msg.uniq_num, msg.get_to_id())) { // Задачу планировщика возьмёт другой узел
+			pull_jobs();
+		}
+		else {
+			pending.resolve(msg);
+		}
+		return;
+	}
+	if (msg.command == CommandType::RETURN || msg.command == CommandType::EXEC_CHILD) { // Узел сообщает о своей очереди
+		jobs.update_credits(msg.get_create_id(), msg.queue_depth, msg.credits);
+	}
+	if (msg.error == ErrorType::QUEUE_FULL) {
+		if (jobs.retry(msg.uniq_num, msg.get_create_id())) {
+			pull_jobs();
+		}
+		else {
+			pending.resolve(msg);
+		}
+		return;
+	}
+	if (msg.command == CommandType::CREATE_CHILD) {
+		if (!confirm_created(msg.get_create_id(), msg.pid)) { // Ответ опоздал, узел уже убран из дерева: его процесс не должен остаться сиротой
+			send(Message(CommandType::REMOVE_CHILD, msg.get_create_id(), 0));
+		}
+	}
+	else if (msg.command == CommandType::PROBE) {
+		probe_answered(msg.get_create_id());
+		return;
+	}
+	else if (msg.command == CommandType::ADOPT_CHILD) {
+		print("OK:" + to_string(msg.get_create_id()) + ":rehomed\n");
+		adopting--;
+		pull_jobs();
+	}
+	else if (msg.command == CommandType::REMOVE_CHILD) {
+		int removed = msg.get_create_id();
+		t.update([this, removed](node_index& nodes) {
+			nodes.delete_el(removed);
+			journal_change(nodes, JournalType::DELETE, removed);
+		});
+		jobs.forget(removed);
+		release_cpus();
+	}
+	else if (msg.command == CommandType::EXEC_CHILD) {
+		if (jobs.complete(msg.uniq_num, msg.error == ErrorType::NONE, next)) { // Освободившийся узел забирает следующую задачу
+			send_job(next);
+		}
+	}
+	pending.resolve(msg);
+}
+
+string server_core::side_endpoint(pid_t owner, bool left) {
+	return create_endpoint(left ? EndpointType::CHILD_PUB_LEFT : EndpointType::CHILD_PUB_RIGHT, owner);
+}
@@ -0,0 +1,64 @@
+#ifndef _SERVER_CORE_H
+#define _SERVER_CORE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "wrap_zmq.h"
+#include "topology.h"
+#include "scheduler.h"
+#include "pending.h"
+#include "journal.h"
+using namespace std;
+
+#define REQUEST_TIMEOUT 1000 // Сколько ждать ответа узла, мс
+#define MAX_QUEUED 1024 // Сколько задач сервер держит в очереди, пока все узлы заняты
+#define AGGREGATE_WAIT 1000 // Срок сбора сводки здоровья дерева, мс
+
+// Запросы сервера к дереву, разбор ответов узлов и переподвешивание детей
+// умерших узлов. Этот код общий для процесса server и стенда sim; наследник
+// даёт отправку сообщений, проверку процесса узла, вывод и то, что есть
+// только у настоящего сервера: журнал, ядра и подключение нового корня.
+class server_core {
+public:
+	topology t; // Дерево узлов
+	scheduler jobs; // Задачи exec без указания узла
+	pending_requests pending; // Запросы, ждущие ответа узлов
+	Codec payload_codec = Codec::RAW; // Как сжимать данные exec
+	int deadline_ms = 0; // Срок задач exec, мс; 0 — без срока
+	atomic<int> adopting; // Переподвешивания, на которые ещё нет ответа
+	server_core();
+	virtual ~server_core() {}
+	void send(Message& msg); // Сообщение корню
+	void send(Message&& msg);
+	void request(Message& msg, reply_handler handler, int timeout_ms); // Отправка запроса, ответ получит handler
+	void create_async(int id, reply_handler handler); // Создать дочерний узел
+	void remove_async(int id, reply_handler handler); // Удалить узел вместе с поддеревом
+	void exec_async(int id, const int* data, int n, reply_handler handler); // Выполнение команды на узле id
+	void exec_any_async(const int* data, int n, reply_handler handler); // Выполнение команды на наименее загруженном узле
+	void cancel_async(int req, reply_handler handler); // Отмена задачи exec, которую узел ещё не начал
+	void aggregate_async(reply_handler handler); // Сводка здоровья всего дерева одним запросом
+	void check_async(int id, int timeout_ms, reply_handler handler); // Проверка доступности узла
+	reply_handler on_error_rehome(int id, reply_handler handler); // Если узел не ответил, ищет умершие узлы на пути к нему
+	void pull_jobs(); // Раздать задачи из очереди свободным узлам
+	void send_job(Message& job); // Отправить задачу, взятую из очереди сервера
+	bool rehome_if_dead(int id); // Ищет умершие узлы на пути к узлу id и переподвешивает их детей; true, если умер сам id
+	void rehome(int id, pid_t dead_pid); // Переподвешивает детей умершего узла к живым узлам
+	void check_created(int id, int parent, const request_result& timeout, reply_handler handler); // CREATE не дождался ответа: жив ли новый узел
+	void drop_created(int id, int parent); // Узел не создан: убрать его из дерева и проверить родителя
+	bool confirm_created(int id, pid_t pid); // Узел запущен процессом pid; false, если его уже нет в дереве
+	void dispatch(Message& msg); // Разбор одного ответа узла
+	static string side_endpoint(pid_t owner, bool left); // Адрес публикации для левого или правого ребёнка процесса owner
+protected:
+	virtual void post(Message& msg) = 0; // Передать готовое сообщение в сокет сервера
+	virtual bool node_alive(pid_t pid) = 0; // Работает ли процесс узла
+	virtual void print(const string& line) = 0; // Строка вывода вместе с \n
+	virtual void rehome_root(vector<Message>& adoptions) = 0; // Первое переподвешивание — к самому серверу, остальные идут уже через новый корень
+	virtual void journal_change(const node_index& nodes, JournalType type, int id, pid_t pid = 0, int side = 0) {} // Изменение дерева, nodes — уже после него
+	virtual int assign_cpu(int id, int parent) { return -1; } // Ядро для нового узла
+	virtual void release_cpus() {} // Ядра удалённых и умерших узлов снова свободны
+	virtual void probe_answered(int id) {} // Узел ответил на проверку после перезапуска
+};
+
+#endif
@@ -0,0 +1,709 @@
+#include <map>
+#include <queue>
+#include <random>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include "clock.h"
+#include "socket.h"
+#include "wrap_zmq.h"
+#include "node_core.h"
+#include "server_core.h"
+
+using namespace std;
+
+// Стенд для воспроизводимых прогонов дерева в одном процессе.
+// Запуск: make sim && ./sim [сценарий]; без файла сценарий читается из stdin.
+// make sim-check прогоняет scenarios/*.txt и сверяет вывод с *.expected рядом,
+// make sim-expected записывает эталоны заново после намеренного изменения вывода.
+//
+// Узлы — объекты sim_node с настоящими Socket поверх inproc:// в общем контексте;
+// маршрутизация и обработка сообщений у них та же node_core, что у client.cpp.
+// Сервер — тот же server_core, что у server.cpp: запросы, разбор ответов и
+// переподвешивание, но без fork, журнала и потоков. Часы виртуальные: доставки
+// сообщений, окончания задач и шаги нагрузки стоят в очереди событий и выполняются
+// по одному, поэтому сценарий с тем же seed повторяется точно, а секундные
+// таймауты проходят за миллисекунды.
+//
+// Команды сценария, # — комментарий:
+//   create ID, remove ID, exec ID|* n v1 ... vn, status ID, cancel REQ, aggregate status,
+//   codec NAME, deadline MS — как у сервера
+//   load COUNT SIZE [GAP_US] — COUNT задач exec * по SIZE случайных значений, раз в GAP_US
+//   heartbit MS — проверять все узлы раз в MS, 0 — перестать
+//   seed N, latency US, service US [NS] — сеть и время задачи: US на задачу и NS на значение
+//   drop P, delay P US, reorder P US — сообщение теряется, задерживает ребро или его обгоняют
+//   kill ID — узел умирает, как от kill -9
+//   wait MS, run — идти MS или пока не ответят все запросы
+//   stats, report — загрузка узлов; задержки запросов и счётчики сети с прошлого report
+
+#define EXPIRE_EVERY_US 10000 // Как часто сервер проверяет сроки запросов, как DISPATCH_WAIT_MS, а узлы — сроки сводок
+#define RUN_LIMIT_US 600000000LL // Дольше run ответов не ждёт
+#define SERVER_PID 1 // pid виртуальные: у сервера этот, узлы получают их по порядку создания
+#define FIRST_NODE_PID 100
+#define MAX_VALUE 1000 // Значения задач load — от 0 до MAX_VALUE - 1
+
+class simulation;
+
+class sim_node : public node_core { // Узел дерева без fork и потока-исполнителя
+public:
+	pid_t parent_pid; // Чей children_subscriber слушает parent_publisher узла; SERVER_PID — сервер
+	bool alive = true;
+	bool working = false; // Исполнитель занят задачей
+	time_point blocked_until; // До этого момента узел спит и не разбирает сообщения
+	sim_node(simulation& new_sim, int new_id, pid_t new_pid, pid_t new_parent_pid, string parent_endpoint);
+	void kill(); // Сокеты закрываются сразу, как при смерти процесса
+protected:
+	pid_t spawn(int new_id, const string& endpoint, int cpu) override;
+	void publish(Socket* socket, Message& msg, bool up) override;
+	void pause(int64_t us, function<void()> then) override;
+	void adopted(pid_t child_pid) override;
+	void exit_node() override;
+	void job_added() override;
+private:
+	simulation& sim;
+	void work(); // Исполнитель берёт следующую задачу
+};
+
+struct sim_event {
+	time_point at;
+	long long seq; // События одного момента идут в порядке постановки
+	bool periodic; // Таймер; run не ждёт, пока кончатся таймеры
+	function<void()> action;
+};
+
+struct later {
+	bool operator()(const sim_event& lhs, const sim_event& rhs) const {
+		return tie(lhs.at, lhs.seq) > tie(rhs.at, rhs.seq);
+	}
+};
+
+struct fault_model { // Сеть между узлами
+	int latency_us = 20; // Доставка по одному ребру
+	double drop = 0; // Доля потерянных сообщений
+	double delay = 0; // Доля сообщений, задерживающих ребро на delay_us; следующие ждут за ними
+	int delay_us = 0;
+	double reorder = 0; // Доля сообщений, отстающих на reorder_us; следующие их обгоняют
+	int reorder_us = 0;
+};
+
+struct net_stats {
+	long long sent = 0; // Отправлено в сокеты
+	long long dropped = 0, delayed = 0, reordered = 0; // Из доставок получателям
+	long long lost = 0; // Дошли до умершего узла
+};
+
+struct latency_log { // Ответы на один вид запросов
+	vector<int64_t> us; // Задержки успешных ответов
+	map<string, int> errors; // Причина -> число
+};
+
+static string error_name(ErrorType error) {
+	switch (error) {
+		case ErrorType::QUEUE_FULL:
+			return "queue full";
+		case ErrorType::NO_ROUTE:
+			return "no route";
+		case ErrorType::TIMEOUT:
+			return "timeout";
+		case ErrorType::EXPIRED:
+			return "expired";
+		case ErrorType::CANCELLED:
+			return "cancelled";
+		default:
+			return "ok";
+	}
+}
+
+static void close_now(Socket*& socket, const vector<string>& bound = {}) { // Как при kill -9, без ожидания close_zmq_socket
+	if (socket == nullptr) {
+		return;
+	}
+	for (const string& endpoint : bound) { // После zmq_close адрес inproc освобождает поток ZMQ, когда успеет; новый родитель его не занял бы
+		zmq_unbind(socket->get_socket(), endpoint.data());
+	}
+	int linger = 0;
+	zmq_setsockopt(socket->get_socket(), ZMQ_LINGER, &linger, sizeof(linger));
+	zmq_close(socket->get_socket());
+	socket = nullptr; // Обёртка не удаляется: её деструктор закрыл бы сокет ещё раз
+}
+
+class simulation : public server_core {
+public:
+	virtual_clock& clock; // Стоит в set_clock до создания стенда: pending_requests читает часы уже в конструкторе
+	void* context;
+	mt19937 rng;
+	fault_model faults;
+	int service_us = 100; // Время задачи exec на узле
+	int service_ns = 0; // И добавка на каждое её значение
+	simulation(virtual_clock& new_clock) : clock(new_clock), rng(1) {
+		set_transport(Transport::INPROC);
+		start = clock.now();
+		wall_start = chrono::steady_clock::now();
+		context = create_zmq_ctx();
+		publisher = new Socket(context, SocketType::PUBLISHER, side_endpoint(SERVER_PID, true));
+		sim_node* root = spawn(0, SERVER_PID, publisher->get_endpoint());
+		subscriber = new Socket(context, SocketType::SUBSCRIBER, create_endpoint(EndpointType::PARENT_PUB, root->get_pid()));
+		root_pid = root->get_pid();
+		t.update([root](node_index& nodes) {
+			nodes.insert(0);
+			nodes.get(0)->pid = root->get_pid();
+			nodes.get(0)->listen_pid = SERVER_PID;
+			nodes.get(0)->listen_left = true;
+		});
+		every(EXPIRE_EVERY_US, [this]() {
+			pending.expire();
+			for (auto& it : all) {
+				if (it->alive) {
+					it->expire_aggregates();
+				}
+			}
+			return true;
+		});
+	}
+	~simulation() {
+		for (auto& it : all) {
+			it->kill();
+		}
+		close_now(publisher);
+		close_now(subscriber);
+		destroy_zmq_ctx(context);
+	}
+	void say(const string& line) { // Строка вывода с виртуальным временем
+		cout << "[" << fixed << setprecision(3) << setw(10) << elapsed_ms(start, clock.now()) << "] " << line;
+		cout.unsetf(ios::fixed);
+	}
+	// События
+	void at(time_point when, function<void()> action, bool periodic = false) {
+		events.push({when, seq++, periodic, move(action)});
+		active += !periodic;
+	}
+	void after(int64_t us, function<void()> action) {
+		at(clock.now() + chrono::microseconds(us), move(action));
+	}
+	void every(int64_t us, function<bool()> tick) { // Пока tick возвращает true
+		at(clock.now() + chrono::microseconds(us), [this, us, tick]() {
+			if (tick()) {
+				every(us, tick);
+			}
+		}, true);
+	}
+	void step() {
+		sim_event event = events.top();
+		events.pop();
+		active -= !event.periodic;
+		clock.advance_to(event.at);
+		try {
+			event.action();
+		}
+		catch (runtime_error& err) {
+			say(string(err.what()) + "\n");
+		}
+	}
+	void wait(int ms) {
+		time_point end = clock.now() + chrono::milliseconds(ms);
+		while (!events.empty() && events.top().at <= end) {
+			step();
+		}
+		clock.advance_to(end);
+	}
+	void run() { // До ответа на все запросы и конца нагрузки
+		time_point limit = clock.now() + chrono::microseconds(RUN_LIMIT_US);
+		while (!events.empty() && (active > 0 || pending.size() > 0) && events.top().at <= limit) {
+			step();
+		}
+		if (pending.size() > 0) {
+			say("Still pending after " + to_string(RUN_LIMIT_US / 1000000) + " s: " + to_string(pending.size()) + "\n");
+		}
+	}
+	// Сеть
+	sim_node* find_pid(pid_t pid) { // Живой узел или nullptr
+		auto it = by_pid.find(pid);
+		return it == by_pid.end() || !it->second->alive ? nullptr : it->second;
+	}
+	sim_node* spawn(int id, pid_t parent_pid, string parent_endpoint) { // Вместо fork и execl
+		all.emplace_back(new sim_node(*this, id, next_pid++, parent_pid, parent_endpoint));
+		by_pid[all.back()->get_pid()] = all.back().get();
+		return all.back().get();
+	}
+	void transmit(pid_t from, Socket* publisher, Message& msg, const vector<pid_t>& receivers, bool up) { // up — родителю, иначе детям
+		// При отправке ZMQ разбирает команды сокета, в том числе новые подключения и подписки,
+		// не чаще раза в миллисекунду настоящего времени: первое сообщение новому узлу то терялось
+		// бы (slow joiner), то нет, в зависимости от скорости машины. Опрос разбирает их сразу
+		zmq_pollitem_t item = {publisher->get_socket(), 0, ZMQ_POLLOUT, 0};
+		zmq_poll(&item, 1, 0);
+		publisher->send(msg);
+		net.sent++;
+		for (pid_t to : receivers) { // Сообщение чужому ребёнку отсеет его подписка
+			sim_node* node = find_pid(to);
+			if (to == SERVER_PID) {
+				drain(from, nullptr, true, subscriber);
+			}
+			else if (node != nullptr) {
+				drain(from, node, up, up ? node->children_subscriber : node->parent_subscriber);
+			}
+		}
+	}
+	void drain(pid_t from, sim_node* to, bool up, Socket* socket) { // Всё, что сокет получил от from, уходит в сеть
+		if (socket == nullptr) {
+			return;
+		}
+		Message msg;
+		while (get_zmq_msg(socket->get_socket(), msg, ZMQ_DONTWAIT)) {
+			deliver(from, to, up, msg);
+		}
+	}
+	void deliver(pid_t from, sim_node* to, bool up, Message& msg) { // Сбои и задержка ребра from -> to
+		uniform_real_distribution<double> coin(0, 1);
+		if (faults.drop > 0 && coin(rng) < faults.drop) {
+			net.dropped++;
+			return;
+		}
+		time_point when = clock.now() + chrono::microseconds(faults.latency_us);
+		if (faults.reorder > 0 && coin(rng) < faults.reorder) { // Не держит ребро: следующие сообщения обгонят
+			net.reordered++;
+			when += chrono::microseconds(faults.reorder_us);
+		}
+		else {
+			if (faults.delay > 0 && coin(rng) < faults.delay) {
+				net.delayed++;
+				when += chrono::microseconds(faults.delay_us);
+			}
+			time_point& last = links[{from, to ? to->get_pid() : SERVER_PID}]; // Ребро доставляет по порядку
+			when = max(when, last);
+			last = when;
+		}
+		at(when, [this, to, up, msg]() mutable {
+			receive(to, up, msg);
+		});
+	}
+	void receive(sim_node* to, bool up, Message& msg) {
+		if (to == nullptr) {
+			dispatch(msg);
+			return;
+		}
+		if (!to->alive) {
+			net.lost++;
+			return;
+		}
+		if (to->blocked_until > clock.now()) { // Узел спит: сообщение ждёт в его сокете
+			at(to->blocked_until, [this, to, up, msg]() mutable {
+				receive(to, up, msg);
+			});
+			return;
+		}
+		if (up) {
+			to->from_child(msg);
+		}
+		else {
+			to->from_parent(msg);
+		}
+	}
+	void rejoin(pid_t child_pid, pid_t new_parent_pid) { // ipc переподключил бы ребёнка к занятому заново адресу сам, inproc — нет
+		sim_node* child = find_pid(child_pid);
+		if (child == nullptr) {
+			return;
+		}
+		child->parent_subscriber->attach(child->parent_subscriber->get_endpoint());
+		child->parent_pid = new_parent_pid;
+	}
+	void kill(int id) {
+		shared_ptr<const node_index> nodes = t.snapshot();
+		sim_node* node = nodes->find(id) ? find_pid(nodes->get(id)->pid) : nullptr;
+		if (node == nullptr) {
+			throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+		}
+		node->kill();
+		say("Node " + to_string(id) + " killed\n");
+	}
+	// Сервер: server_core, как у server.cpp
+	void post(Message& msg) override {
+		transmit(SERVER_PID, publisher, msg, {root_pid}, false);
+	}
+	bool node_alive(pid_t pid) override {
+		return find_pid(pid) != nullptr;
+	}
+	void print(const string& line) override {
+		say(line);
+	}
+	void rehome_root(vector<Message>& adoptions) override { // Как поток ввода-вывода server.cpp: сначала новый корень, через REJOIN_WAIT остальные
+		adopt_root(adoptions[0]);
+		vector<Message> rest(adoptions.begin() + 1, adoptions.end());
+		after(REJOIN_WAIT, [this, rest]() mutable {
+			for (Message& msg : rest) {
+				send(msg);
+			}
+			pull_jobs();
+		});
+	}
+	void adopt_root(Message& msg) {
+		publisher->attach(side_endpoint(msg.buf[0], msg.buf[1]));
+		subscriber->attach(create_endpoint(EndpointType::PARENT_PUB, msg.pid));
+		rejoin(msg.pid, SERVER_PID);
+		root_pid = msg.pid;
+		Message done = msg;
+		after(REJOIN_WAIT, [this, done]() mutable { // Ответит уже сам корень
+			done.get_to_id() = done.get_create_id();
+			send(done);
+		});
+	}
+	void heartbit(int ms) { // Как heartbits_func, но раунды не ждут друг друга
+		int round = ++heartbit_round;
+		if (ms <= 0) {
+			return;
+		}
+		every(ms * 1000LL, [this, round, ms]() {
+			if (round != heartbit_round) {
+				return false;
+			}
+			for (int id : t.snapshot()->get_all_elems()) {
+				check_async(id, ms, [this, id](const request_result& result) {
+					if (result.error != ErrorType::NONE && !rehome_if_dead(id)) {
+						say("Heartbit: node " + to_string(id) + " is unavailable now\n");
+					}
+				});
+			}
+			return true;
+		});
+	}
+	// Учёт задержек
+	reply_handler measured(string kind, bool verbose, reply_handler then = nullptr) { // verbose — печатать ответ
+		time_point issued = clock.now();
+		return [this, kind, verbose, then, issued](const request_result& result) {
+			latency_log& log = latencies[kind];
+			if (result.error == ErrorType::NONE) {
+				log.us.push_back(chrono::duration_cast<chrono::microseconds>(clock.now() - issued).count());
+			}
+			else {
+				log.errors[error_name(result.error)]++;
+			}
+			if (verbose) {
+				say(describe(result));
+			}
+			if (then) {
+				then(result);
+			}
+		};
+	}
+	void refused(string kind) { // Сервер отказал сразу, запрос не ушёл
+		latencies[kind].errors["refused"]++;
+	}
+	void report() { // Ничего не печатает, если с прошлого report запросов и сообщений не было
+		if (latencies.empty() && net.sent == 0) {
+			return;
+		}
+		double wall = chrono::duration<double, milli>(chrono::steady_clock::now() - wall_start).count();
+		say("Virtual " + fixed_ms(elapsed_ms(start, clock.now())) + " ms, wall " + fixed_ms(wall) + " ms\n");
+		cout << left << setw(10) << "Request" << right << setw(8) << "count" << setw(8) << "ok"
+			<< setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "max us" << "  errors\n";
+		for (auto& it : latencies) {
+			vector<int64_t>& us = it.second.us;
+			sort(us.begin(), us.end());
+			int count = us.size();
+			for (auto& error : it.second.errors) {
+				count += error.second;
+			}
+			cout << left << setw(10) << it.first << right << setw(8) << count << setw(8) << us.size();
+			for (int q : {50, 90, 99, 100}) {
+				cout << setw(10) << (us.empty() ? 0 : us[min(us.size() - 1, us.size() * q / 100)]);
+			}
+			cout << " ";
+			for (auto& error : it.second.errors) {
+				cout << " " << error.first << " " << error.second;
+			}
+			cout << "\n";
+		}
+		cout << "Messages: sent " << net.sent << ", dropped " << net.dropped << ", delayed " << net.delayed
+			<< ", reordered " << net.reordered << ", lost at dead nodes " << net.lost << "\n";
+		latencies.clear();
+		net = net_stats();
+		wall_start = chrono::steady_clock::now();
+	}
+	void command(const string& cmd, istream& args);
+private:
+	time_point start; // Начало прогона по виртуальным часам
+	chrono::steady_clock::time_point wall_start; // Начало замера по настоящим часам
+	Socket* publisher; // Сокеты сервера
+	Socket* subscriber;
+	pid_t root_pid;
+	pid_t next_pid = FIRST_NODE_PID;
+	vector<unique_ptr<sim_node>> all; // Все узлы прогона, и умершие тоже
+	map<pid_t, sim_node*> by_pid;
+	priority_queue<sim_event, vector<sim_event>, later> events;
+	long long seq = 0;
+	int active = 0; // Событий в очереди, кроме таймеров
+	int heartbit_round = 0; // Раунды прошлых команд heartbit останавливаются
+	map<pair<pid_t, pid_t>, time_point> links; // Ребро from -> to: когда доставлено последнее сообщение
+	net_stats net;
+	map<string, latency_log> latencies; // Вид запроса -> задержки
+	static double elapsed_ms(time_point from, time_point to) {
+		return chrono::duration<double, milli>(to - from).count();
+	}
+	static string fixed_ms(double ms) {
+		ostringstream out;
+		out << fixed << setprecision(1) << ms;
+		return out.str();
+	}
+};
+
+sim_node::sim_node(simulation& new_sim, int new_id, pid_t new_pid, pid_t new_parent_pid, string parent_endpoint)
+	: node_core(new_sim.context, new_id, new_pid, parent_endpoint), parent_pid(new_parent_pid), sim(new_sim) {}
+
+void sim_node::kill() {
+	if (!alive) {
+		return;
+	}
+	alive = false;
+	jobs.close();
+	close_now(parent_publisher, {parent_publisher->get_endpoint()});
+	close_now(parent_subscriber);
+	close_now(children_publisher, children_endpoints);
+	close_now(children_subscriber);
+}
+
+pid_t sim_node::spawn(int new_id, const string& endpoint, int) {
+	return sim.spawn(new_id, pid, endpoint)->get_pid();
+}
+
+void sim_node::publish(Socket* socket, Message& msg, bool up) {
+	if (up) {
+		sim.transmit(pid, socket, msg, {parent_pid}, true);
+	}
+	else {
+		sim.transmit(pid, socket, msg, {child_pids[0], child_pids[1]}, false);
+	}
+}
+
+void sim_node::pause(int64_t us, function<void()> then) { // Узел не разбирает сообщения, как client.cpp во сне
+	blocked_until = sim.clock.now() + chrono::microseconds(us);
+	sim.at(blocked_until, [this, then]() {
+		if (alive) {
+			then();
+		}
+	});
+}
+
+void sim_node::adopted(pid_t child_pid) {
+	sim.rejoin(child_pid, pid);
+}
+
+void sim_node::exit_node() {
+	kill();
+}
+
+void sim_node::job_added() {
+	work();
+}
+
+void sim_node::work() {
+	Message msg;
+	while (!working && jobs.size() > 0 && jobs.pop(msg)) {
+		if (!start_job(msg)) {
+			continue;
+		}
+		working = true;
+		sim.after(sim.service_us + (int64_t)sim.service_ns * msg.size / 1000, [this, msg]() mutable {
+			if (!alive) {
+				return;
+			}
+			working = false;
+			finish_job(msg);
+			work();
+		});
+	}
+}
+
+vector<int> read_values(istream& args) { // "n v1 ... vn", как у сервера
+	int n;
+	if (!(args >> n) || n < 0 || n > MAX_SIZE) {
+		throw runtime_error("Error: Wrong number of elements.");
+	}
+	vector<int> v(n);
+	for (int i = 0; i < n; i++) {
+		args >> v[i];
+	}
+	return v;
+}
+
+void simulation::command(const string& cmd, istream& args) {
+	if (cmd == "create") {
+		int id;
+		args >> id;
+		create_async(id, measured("create", true));
+	}
+	else if (cmd == "remove") {
+		int id;
+		args >> id;
+		if (id == 0) {
+			throw runtime_error("Can't remove root");
+		}
+		remove_async(id, measured("remove", true));
+	}
+	else if (cmd == "exec") {
+		string target;
+		args >> target;
+		if (target == "*") {
+			vector<int> v = read_values(args);
+			exec_any_async(v.data(), v.size(), measured("exec *", true));
+		}
+		else {
+			int id = stoi(target);
+			vector<int> v = read_values(args);
+			exec_async(id, v.data(), v.size(), measured("exec", true));
+		}
+	}
+	else if (cmd == "status") {
+		int id;
+		args >> id;
+		if (!t.snapshot()->find(id)) {
+			throw runtime_error("Error:" + to_string(id) + ":Node with that number doesn't exist.");
+		}
+		check_async(id, REQUEST_TIMEOUT, measured("status", false, [this, id](const request_result& result) {
+			if (result.error == ErrorType::NONE) {
+				say("OK\n");
+				return;
+			}
+			rehome_if_dead(id);
+			say("Node is unavailable\n");
+		}));
+	}
+	else if (cmd == "cancel") {
+		int req;
+		args >> req;
+		cancel_async(req, measured("cancel", true));
+	}
+	else if (cmd == "aggregate") {
+		string what;
+		args >> what;
+		if (what != "status") {
+			throw runtime_error("Error: Usage: aggregate status");
+		}
+		aggregate_async(measured("aggregate", true));
+	}
+	else if (cmd == "load") {
+		int count, size;
+		int64_t gap_us = 0;
+		args >> count >> size >> gap_us;
+		if (count < 0 || size < 0 || size > MAX_SIZE) {
+			throw runtime_error("Error: Usage: load COUNT SIZE [GAP_US]");
+		}
+		uniform_int_distribution<int> value(0, MAX_VALUE - 1);
+		for (int i = 0; i < count; i++) {
+			vector<int> v(size);
+			for (int& x : v) {
+				x = value(rng);
+			}
+			after(i * gap_us, [this, v]() {
+				try {
+					exec_any_async(v.data(), v.size(), measured("load", false));
+				}
+				catch (runtime_error&) {
+					refused("load");
+				}
+			});
+		}
+	}
+	else if (cmd == "codec") {
+		string name;
+		args >> name;
+		if (!parse_codec(name, payload_codec)) {
+			throw runtime_error("Error: Unknown codec, expected raw, delta or for.");
+		}
+	}
+	else if (cmd == "deadline") {
+		args >> deadline_ms;
+	}
+	else if (cmd == "heartbit") {
+		int ms;
+		args >> ms;
+		heartbit(ms);
+	}
+	else if (cmd == "seed") {
+		unsigned seed;
+		args >> seed;
+		rng.seed(seed);
+	}
+	else if (cmd == "latency") {
+		args >> faults.latency_us;
+	}
+	else if (cmd == "service") {
+		args >> service_us >> service_ns;
+	}
+	else if (cmd == "drop") {
+		args >> faults.drop;
+	}
+	else if (cmd == "delay") {
+		args >> faults.delay >> faults.delay_us;
+	}
+	else if (cmd == "reorder") {
+		args >> faults.reorder >> faults.reorder_us;
+	}
+	else if (cmd == "kill") {
+		int id;
+		args >> id;
+		kill(id);
+	}
+	else if (cmd == "wait") {
+		int ms;
+		args >> ms;
+		wait(ms);
+	}
+	else if (cmd == "run") {
+		run();
+	}
+	else if (cmd == "stats") {
+		jobs.print_stats(cout);
+	}
+	else if (cmd == "report") {
+		report();
+	}
+	else {
+		throw runtime_error("It is not a command!");
+	}
+}
+
+int main(int argc, char const *argv[]) {
+	ifstream file;
+	if (argc > 2) {
+		cout << "Usage: ./sim [script]" << endl;
+		return -1;
+	}
+	if (argc == 2) {
+		file.open(argv[1]);
+		if (!file) {
+			cout << "Can not open " << argv[1] << endl;
+			return -1;
+		}
+	}
+	istream& script = argc == 2 ? file : cin;
+	virtual_clock clock;
+	set_clock(&clock);
+	try {
+		simulation sim(clock);
+		string line;
+		while (getline(script, line)) {
+			istringstream args(line.substr(0, line.find('#')));
+			string cmd;
+			if (!(args >> cmd)) {
+				continue;
+			}
+			try {
+				sim.command(cmd, args);
+			}
+			catch (const runtime_error& err) {
+				sim.say(string(err.what()) + "\n");
+			}
+		}
+		sim.run();
+		sim.report();
+	}
+	catch (const runtime_error& err) {
+		cout << err.what() << endl;
+		return -1;
+	}
+	return 0;
+}
@@ -5,13 +5,19 @@
 
 using namespace std;
 
-Socket::Socket(void* context, SocketType new_socket_type, string new_endpoint) : socket_type(new_socket_type), endpoint(new_endpoint) {
+Socket::Socket(void* context, SocketType new_socket_type, string new_endpoint, const vector<int>& routes) : socket_type(new_socket_type), endpoint(new_endpoint) {
 	socket = create_zmq_socket(context, new_socket_type);
 	switch (socket_type) {
 		case SocketType::PUBLISHER:
 			bind_zmq_socket(socket, new_endpoint);
 			break;
 		case SocketType::SUBSCRIBER:
+			if (routes.empty()) {
+				subscribe_zmq_socket(socket);
+			}
+			for (int route : routes) { // До connect, чтобы чужие сообщения не проскочили
+				subscribe_zmq_socket(socket, route);
+			}
 			connect_zmq_socket(socket, new_endpoint);
 			break;
 		default:
@@ -21,15 +27,17 @@ Socket::Socket(void* context, SocketType new_socket_type, string new_endpoint) :
 
 Socket::~Socket() {
 	try {
-		switch(socket_type) {
-			case SocketType::PUBLISHER:
-				cout << "unbind: " << endpoint << endl;
-				unbind_zmq_socket(socket, endpoint);
-				break;
-			case SocketType::SUBSCRIBER:
-				cout << "disconnect: " << endpoint << endl; 
-				disconnect_zmq_socket(socket, endpoint);
-				break;
+		if (!endpoint.empty()) { // Пустой адрес уже отключён через detach
+			switch(socket_type) {
+				case SocketType::PUBLISHER:
+					cout << "unbind: " << endpoint << endl;
+					unbind_zmq_socket(socket, endpoint);
+					break;
+				case SocketType::SUBSCRIBER:
+					cout << "disconnect: " << endpoint << endl; 
+					disconnect_zmq_socket(socket, endpoint);
+					break;
+			}
 		}
 		close_zmq_socket(socket);
 	} 
@@ -38,7 +46,28 @@ Socket::~Socket() {
 	}
 }
 
-void Socket::send(Message message) {
+void Socket::attach(string other_endpoint) {
+	if (socket_type == SocketType::PUBLISHER) {
+		bind_zmq_socket(socket, other_endpoint);
+	}
+	else {
+		connect_zmq_socket(socket, other_endpoint);
+	}
+}
+
+void Socket::detach(string other_endpoint) {
+	if (other_endpoint == endpoint) { // Деструктору отключать уже нечего
+		endpoint.clear();
+	}
+	if (socket_type == SocketType::PUBLISHER) {
+		unbind_zmq_socket(socket, other_endpoint);
+	}
+	else {
+		disconnect_zmq_socket(socket, other_endpoint);
+	}
+}
+
+void Socket::send(const Message& message) {
     if (socket_type == SocketType::PUBLISHER) {
         send_zmq_msg(socket, message);
     } 
@@ -47,9 +76,9 @@ void Socket::send(Message message) {
     }
 }
 
-Message Socket::receive() {
+bool Socket::receive(Message& message) {
     if (socket_type == SocketType::SUBSCRIBER) {
-        return get_zmq_msg(socket);
+        return get_zmq_msg(socket, message);
     } 
     else {
         throw logic_error("PUB socket can't receive messages");
@@ -2,6 +2,7 @@
 #define _SOCKET_H
 
 #include <string>
+#include <vector>
 #include "wrap_zmq.h" 
 using namespace std;
 
@@ -10,10 +11,12 @@ public:
     void* socket;
     SocketType socket_type; 
     string endpoint; 
-    Socket(void* context, SocketType new_socket_type, string new_endpoint);
+    Socket(void* context, SocketType new_socket_type, string new_endpoint, const vector<int>& routes = {}); // routes — на какие route подписаться; пусто — на все сообщения
     ~Socket();
-    void send(Message message); 
-    Message receive();
+    void attach(string other_endpoint); // Ещё один адрес: bind для PUB, connect для SUB
+    void detach(string other_endpoint); // Отключиться от адреса, добавленного через attach
+    void send(const Message& message); 
+    bool receive(Message& message); // false, если сообщение не пришло (например, по таймауту)
     string get_endpoint(); 
     void*& get_socket();
 };
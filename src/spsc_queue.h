@@ -0,0 +1,82 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+using namespace std;
+
+// Кольцевая очередь на одного писателя и одного читателя без блокировок.
+// Писатель заполняет ячейку на месте (slot + commit), читатель разбирает
+// её тоже на месте (front + pop), поэтому большие сообщения не копируются.
+// Мьютекс нужен только чтобы усыпить читателя на пустой очереди.
+template <class T>
+class spsc_queue {
+public:
+	spsc_queue(size_t capacity) : cells(round_up(capacity)), mask(cells.size() - 1), head(0), tail(0), sleeping(false) {}
+	T* slot() { // Свободная ячейка для писателя или nullptr, если очередь заполнена
+		size_t t = tail.load(memory_order_relaxed);
+		if (t - head.load(memory_order_acquire) == cells.size()) {
+			return nullptr;
+		}
+		return &cells[t & mask];
+	}
+	void commit() { // Отдать заполненную ячейку читателю
+		tail.store(tail.load(memory_order_relaxed) + 1, memory_order_seq_cst);
+		if (sleeping.load(memory_order_seq_cst)) {
+			lock_guard<mutex> lock(mtx);
+			wakeup.notify_one();
+		}
+	}
+	bool push(const T& value) { // false, если очередь заполнена
+		T* cell = slot();
+		if (cell == nullptr) {
+			return false;
+		}
+		*cell = value;
+		commit();
+		return true;
+	}
+	T* front() { // Первая ячейка для читателя или nullptr, если очередь пуста
+		size_t h = head.load(memory_order_relaxed);
+		if (h == tail.load(memory_order_acquire)) {
+			return nullptr;
+		}
+		return &cells[h & mask];
+	}
+	void pop() { // Освободить ячейку, полученную через front
+		head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+	T* wait_front(int timeout_ms) { // front, при пустой очереди ждёт писателя не дольше timeout_ms
+		T* cell = front();
+		if (cell != nullptr) {
+			return cell;
+		}
+		unique_lock<mutex> lock(mtx);
+		sleeping.store(true, memory_order_seq_cst);
+		if (head.load(memory_order_relaxed) == tail.load(memory_order_seq_cst)) {
+			wakeup.wait_for(lock, chrono::milliseconds(timeout_ms));
+		}
+		sleeping.store(false, memory_order_relaxed);
+		return front();
+	}
+private:
+	vector<T> cells;
+	size_t mask;
+	alignas(64) atomic<size_t> head; // Следующая ячейка читателя
+	alignas(64) atomic<size_t> tail; // Следующая ячейка писателя
+	atomic<bool> sleeping; // Читатель ждёт на пустой очереди
+	mutex mtx;
+	condition_variable wakeup;
+	static size_t round_up(size_t n) { // Ёмкость — степень двойки, чтобы номер ячейки брался маской
+		size_t size = 1;
+		while (size < n) {
+			size *= 2;
+		}
+		return size;
+	}
+};
+
+#endif
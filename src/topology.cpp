@@ -0,0 +1,8 @@
+#include "topology.h"
+using namespace std;
+
+topology::topology() : current(make_shared<node_index>()) {}
+
+shared_ptr<const node_index> topology::snapshot() const {
+	return atomic_load(&current);
+}
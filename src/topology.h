@@ -0,0 +1,28 @@
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <mutex>
+#include <memory>
+#include "node_index.h"
+using namespace std;
+
+// Дерево узлов, опубликованное неизменяемым снимком. Читатели берут снимок
+// без блокировок и работают с ним сколько угодно долго. Писатели по одному
+// копируют текущее дерево, меняют копию и атомарно публикуют её.
+class topology {
+public:
+	topology();
+	shared_ptr<const node_index> snapshot() const; // Текущий снимок дерева
+	template <class F>
+	void update(F mutate) { // Применить изменение и опубликовать новый снимок
+		lock_guard<mutex> lock(writer);
+		shared_ptr<node_index> next = make_shared<node_index>(*atomic_load(&current));
+		mutate(*next);
+		atomic_store(&current, shared_ptr<const node_index>(move(next)));
+	}
+private:
+	shared_ptr<const node_index> current; // Последний опубликованный снимок
+	mutex writer; // Изменения применяются строго по одному
+};
+
+#endif
@@ -1,21 +1,32 @@
 #include <tuple>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <cstdlib>
 #include <iostream>
-#include <unistd.h>
 #include "wrap_zmq.h"
+#include "clock.h"
 
 using namespace std;
 
+int64_t monotonic_us() { // Системные часы — это CLOCK_MONOTONIC, поэтому сроки понятны всем узлам
+	return chrono::duration_cast<chrono::microseconds>(clock_now().time_since_epoch()).count();
+}
+
 void* create_zmq_ctx() {
 	void* context  = zmq_ctx_new();
 	if (context == nullptr) {
 		throw runtime_error("Can not create new context.");
 	}
+	const char* io_threads = getenv(IO_THREADS_ENV);
+	if (io_threads != nullptr && zmq_ctx_set(context, ZMQ_IO_THREADS, atoi(io_threads)) != 0) { // До первого сокета
+		throw runtime_error("Can not set context I/O threads.");
+	}
 	return context;
 }
 
 void destroy_zmq_ctx(void* context) {
-	sleep(1);
+	sleep_ms(1000);
 	if (zmq_ctx_destroy(context) != 0) {
 		throw runtime_error("Can not destroy context.");
 	}
@@ -28,6 +39,12 @@ int get_zmq_socket_type(SocketType type) {
 	if (type == SocketType::SUBSCRIBER) {
 		return ZMQ_SUB;
 	}
+	if (type == SocketType::PUSH) {
+		return ZMQ_PUSH;
+	}
+	if (type == SocketType::PULL) {
+		return ZMQ_PULL;
+	}
 	else {
 		throw runtime_error("Undefined socket type.");
 	}
@@ -43,21 +60,28 @@ void* create_zmq_socket(void* context, SocketType type) {
 }
 
 void close_zmq_socket(void* socket) {
-	sleep(1);
+	sleep_ms(1000);
 	if (zmq_close(socket) != 0) {
 		throw runtime_error("Can not close socket.");
 	}
 }
 
+static Transport transport = Transport::IPC;
+
+void set_transport(Transport new_transport) {
+	transport = new_transport;
+}
+
 string create_endpoint(EndpointType type, pid_t id) {
+	string prefix = transport == Transport::INPROC ? "inproc://" : "ipc:///tmp/";
 	if (type == EndpointType::PARENT_PUB) {
-		return "ipc:///tmp/parent_pub_" + to_string(id);
+		return prefix + "parent_pub_" + to_string(id);
 	}
 	else if (type == EndpointType::CHILD_PUB_LEFT) {
-		return "ipc:///tmp/child_pub_left_" + to_string(id);
+		return prefix + "child_pub_left_" + to_string(id);
 	}
 	else if (type == EndpointType::CHILD_PUB_RIGHT) {
-		return "ipc:///tmp/child_pub_right" + to_string(id);
+		return prefix + "child_pub_right" + to_string(id);
 	}
 	else {
 		throw runtime_error("Wrong Endpoint type.");
@@ -71,7 +95,7 @@ void bind_zmq_socket(void* socket, string endpoint) {
 }
 
 void unbind_zmq_socket(void* socket, string endpoint) {
-	sleep(1);
+	sleep_ms(1000);
 	if (zmq_unbind(socket, endpoint.data()) != 0) { 
 		throw runtime_error("Can not unbind socket.");	
 	}
@@ -81,7 +105,18 @@ void connect_zmq_socket(void* socket, string endpoint) {
 	if (zmq_connect(socket, endpoint.data()) != 0) {
 		throw runtime_error("Can not connect socket.");	
 	}
-	zmq_setsockopt(socket, ZMQ_SUBSCRIBE, 0, 0);
+}
+
+void subscribe_zmq_socket(void* socket) {
+	if (zmq_setsockopt(socket, ZMQ_SUBSCRIBE, 0, 0) != 0) {
+		throw runtime_error("Can not subscribe socket.");
+	}
+}
+
+void subscribe_zmq_socket(void* socket, int route) {
+	if (zmq_setsockopt(socket, ZMQ_SUBSCRIBE, &route, sizeof(route)) != 0) {
+		throw runtime_error("Can not subscribe socket.");
+	}
 }
 
 void disconnect_zmq_socket(void* socket, string endpoint) {
@@ -98,7 +133,7 @@ Message::Message() {
 	to_up = false;
 }
 
-Message::Message(CommandType new_command, int new_to_id, int n, int buffer[], int new_id): command(new_command), to_id(new_to_id), size(n), uniq_num(counter++), to_up(false), create_id(new_id) {
+Message::Message(CommandType new_command, int new_to_id, int n, const int buffer[], int new_id): command(new_command), to_id(new_to_id), size(n), uniq_num(counter++), to_up(false), create_id(new_id) {
 	for (int i = 0; i < size; i++) {
 		buf[i] = buffer[i];
 	}
@@ -118,28 +153,79 @@ int& Message::get_to_id() {
 	return to_id;
 }
 
-void create_zmq_msg(zmq_msg_t* zmq_msg, Message& msg) {  
-	zmq_msg_init_size(zmq_msg, sizeof(msg)); 
-	memcpy(zmq_msg_data(zmq_msg), &msg, sizeof(msg));
+size_t Message::wire_size() const {
+	if (codec != Codec::RAW) {
+		return sizeof(Message) - sizeof(buf) + max(0, min(bytes, (int)sizeof(buf)));
+	}
+	return sizeof(Message) - sizeof(buf) + sizeof(int) * max(0, min(size, MAX_SIZE));
 }
 
-void send_zmq_msg(void* socket, Message& msg) { 
-	zmq_msg_t zmq_msg;
-	create_zmq_msg(&zmq_msg, msg);
-	if (!zmq_msg_send(&zmq_msg, socket, 0)) {
+void Message::encode(Codec new_codec) {
+	if (codec != Codec::RAW || new_codec == Codec::RAW || size <= 0) {
+		return;
+	}
+	unsigned char packed[sizeof(buf)];
+	int n = encode_values(new_codec, buf, size, packed, size * sizeof(int) - 1);
+	if (n == -1) { // Не меньше исходных данных
+		return;
+	}
+	memcpy(buf, packed, n);
+	codec = new_codec;
+	bytes = n;
+}
+
+int Message::payload_sum() const {
+	int length = codec == Codec::RAW ? max(0, min(size, MAX_SIZE)) * (int)sizeof(int) : max(0, min(bytes, (int)sizeof(buf)));
+	return decode_sum(codec, (const unsigned char*)buf, size, length);
+}
+
+void Message::set_deadline(int timeout_ms) {
+	deadline = timeout_ms > 0 ? monotonic_us() + (int64_t)timeout_ms * 1000 : 0;
+}
+
+bool Message::expired() const {
+	return deadline != 0 && monotonic_us() >= deadline;
+}
+
+void Message::clear_payload() {
+	codec = Codec::RAW;
+	bytes = 0;
+	size = 0;
+}
+
+void send_zmq_msg(void* socket, const Message& msg) { // ZMQ сам копирует заполненную часть сообщения в кадр
+	if (zmq_send(socket, &msg, msg.wire_size(), 0) == -1) {
 		throw runtime_error("Can not send message.");
 	}
-	zmq_msg_close(&zmq_msg);
 }
 
-Message get_zmq_msg(void* socket) {
-	zmq_msg_t zmq_msg;
-	zmq_msg_init(&zmq_msg);
-	if (zmq_msg_recv(&zmq_msg, socket, 0) == -1) { 
-		return Message();
+static bool well_formed(const Message& msg, int length) { // Длины из заголовка сходятся с размером принятого кадра
+	if (length < (int)(sizeof(Message) - sizeof(msg.buf)) || length > (int)sizeof(Message)) { // Короче заголовка или обрезан при приёме
+		return false;
+	}
+	if (msg.size < 0 || msg.size > MAX_SIZE) {
+		return false;
+	}
+	if (msg.codec != Codec::RAW && msg.codec != Codec::DELTA_VARINT && msg.codec != Codec::FOR_BITPACK) {
+		return false;
+	}
+	if (msg.codec != Codec::RAW && (msg.bytes < 0 || msg.bytes > (int)sizeof(msg.buf))) {
+		return false;
+	}
+	return length == (int)msg.wire_size();
+}
+
+bool get_zmq_msg(void* socket, Message& msg, int flags) { // Принимает сообщение прямо в msg, без промежуточных копий
+	while (true) {
+		int length = zmq_recv(socket, &msg, sizeof(msg), flags);
+		if (length == -1) { 
+			msg.command = CommandType::ERROR;
+			msg.size = 0;
+			return false;
+		}
+		if (well_formed(msg, length)) {
+			return true;
+		}
+		// Битый кадр отбрасываем и ждём следующий
 	}
-	Message msg;
-	memcpy(&msg, zmq_msg_data(&zmq_msg), sizeof(msg)); 
-	zmq_msg_close(&zmq_msg);
-	return msg;
 }
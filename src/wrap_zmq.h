@@ -2,10 +2,12 @@
 #define _WRAP_ZMQ_H
 
 #include <tuple>
+#include <cstdint>
 #include <vector>
 #include <atomic>
 #include <string>
 #include "zmq.h"
+#include "codec.h"
 
 using namespace std;
 
@@ -14,10 +16,18 @@ using namespace std;
 #define UNIVERSAL_MSG -1
 #define SERVER_ID -2
 #define PARENT_SIGNAL -3
+#define ROUTE_ALL UNIVERSAL_MSG // route сообщения, которое получают оба ребёнка
+
+#define IO_THREADS_ENV "TREE_IO_THREADS" // Сколько потоков ввода-вывода у контекста ZMQ процесса, по умолчанию 1
+
+#define REJOIN_WAIT 300000 // Время на переподключение переподвешенного узла, мкс
+#define QUEUE_SIZE 16 // Сколько задач exec может ждать на узле; столько сервер и даёт узлу, пока тот не сообщил о своей очереди
 
 enum struct SocketType {
 	PUBLISHER,
 	SUBSCRIBER,
+	PUSH, // Очередь отправки между потоками одного процесса
+	PULL,
 };
 
 enum struct CommandType {
@@ -26,6 +36,24 @@ enum struct CommandType {
 	CREATE_CHILD,
 	REMOVE_CHILD,
 	EXEC_CHILD,
+	ADOPT_CHILD,
+	PROBE, // Проверка всего дерева: каждый узел отвечает и передаёт её детям
+	CANCEL, // Отмена задачи exec из очереди узла; buf[0] — её uniq_num
+	AGGREGATE, // Сводка здоровья поддерева, собирается снизу вверх
+};
+
+enum struct ErrorType {
+	NONE,
+	QUEUE_FULL, // Очередь задач узла заполнена
+	NO_ROUTE, // На пути к узлу нет нужного ребёнка
+	TIMEOUT, // Ответ не пришёл вовремя
+	EXPIRED, // Срок запроса истёк раньше, чем узел взялся за него
+	CANCELLED, // Запрос отменён командой cancel
+};
+
+enum struct Transport {
+	IPC, // Файлы в /tmp, узлы — отдельные процессы
+	INPROC, // Узлы в одном процессе с общим контекстом ZMQ, как в стенде sim
 };
 
 enum struct EndpointType {
@@ -37,36 +65,55 @@ enum struct EndpointType {
 class Message {
 public:
 	static std::atomic<int> counter;
+	int route = ROUTE_ALL; // Кому из детей на общем канале: подписка ZMQ смотрит на первые байты, поэтому поле первое
 	CommandType command = CommandType::ERROR; 
 	int to_id; 
 	int create_id;
 	int uniq_num;
 	bool to_up; 
 	int cnt_substring;
-	int size;
-	int buf[MAX_SIZE];
 	int sum;
+	pid_t pid = 0; // pid созданного или переподвешиваемого узла
+	ErrorType error = ErrorType::NONE; // Почему запрос не выполнен
+	int queue_depth = 0; // Задач в очереди отвечающего узла
+	int credits = 0; // Сколько ещё задач узел готов принять
+	int cpu = -1; // Ядро, к которому привязать создаваемый узел; -1 — без привязки
+	int64_t deadline = 0; // Срок запроса по монотонным часам, мкс; 0 — без срока
+	Codec codec = Codec::RAW; // Как закодированы данные в buf
+	int bytes = 0; // Длина закодированных данных, байт; для RAW не используется
+	int size = 0; // Число значений данных
+	int buf[MAX_SIZE]; // Должен быть последним полем: по сети передаётся только заполненная часть
 	Message();
-	Message(CommandType new_command, int new_to_id, int size, int buf[], int new_id);
+	Message(CommandType new_command, int new_to_id, int size, const int buf[], int new_id);
 	Message(CommandType new_command, int new_to_id, int new_id);
 	friend bool operator == (const Message& lhs, const Message& rhs);
 	int& get_create_id(); 
 	int& get_to_id();
+	size_t wire_size() const; // Размер сообщения в кадре ZMQ
+	void encode(Codec new_codec); // Сжать данные; если сжатие не выгодно, они остаются RAW
+	int payload_sum() const; // Сумма данных, не распаковывая их в массив
+	void clear_payload(); // Ответу данные не нужны
+	void set_deadline(int timeout_ms); // Срок через timeout_ms от текущего момента; 0 — без срока
+	bool expired() const;
 };
 
+int64_t monotonic_us(); // Монотонные часы, общие для всех процессов машины; в sim — виртуальные
+
 void* create_zmq_ctx();
 void destroy_zmq_ctx(void* context);
 int get_zmq_socket_type(SocketType type);
 void* create_zmq_socket(void* context, SocketType type);
 void close_zmq_socket(void* socket);
+void set_transport(Transport transport); // До создания первого адреса
 string create_endpoint(EndpointType type, pid_t id);
 void bind_zmq_socket(void* socket, string endpoint);
 void unbind_zmq_socket(void* socket, string endpoint);
 void connect_zmq_socket(void* socket, string endpoint);
+void subscribe_zmq_socket(void* socket); // Подписка на все сообщения
+void subscribe_zmq_socket(void* socket, int route); // Подписка на сообщения с этим route
 void disconnect_zmq_socket(void* socket, string endpoint);
 
-void create_zmq_msg(zmq_msg_t* zmq_msg, Message& msg);
-void send_zmq_msg(void* socket, Message& msg);
-Message get_zmq_msg(void* socket);
+void send_zmq_msg(void* socket, const Message& msg);
+bool get_zmq_msg(void* socket, Message& msg, int flags = 0); // flags = ZMQ_DONTWAIT — не ждать сообщения
 
 #endif